@@ -1,5 +1,8 @@
 #pragma once
 #include <array>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "core/murmur3.h"
 
@@ -37,18 +40,34 @@ struct array_bool {
     }
 
     bool contains(const array_bool& b) const {
-        for (uint i = 0; i < Words; i++)
+        uint i = 0;
+#ifdef __AVX2__
+        // b is contained if (b & ~this) is zero, 256 bits at a time.
+        for (; i + Lanes <= Words; i += Lanes)
+            if (!_mm256_testc_si256(load(i), b.load(i))) return false;
+#endif
+        for (; i < Words; i++)
             if ((words[i] | b.words[i]) != words[i]) return false;
         return true;
     }
-};
 
-template <uint Size>
-inline bool operator==(const array_bool<Size>& a, const array_bool<Size>& b) {
-    for (uint i = 0; i < array_bool<Size>::Words; i++)
-        if (a.words[i] != b.words[i]) return false;
-    return true;
-}
+    bool operator==(const array_bool& b) const {
+        uint i = 0;
+#ifdef __AVX2__
+        for (; i + Lanes <= Words; i += Lanes)
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(load(i), b.load(i))) != -1) return false;
+#endif
+        for (; i < Words; i++)
+            if (words[i] != b.words[i]) return false;
+        return true;
+    }
+
+private:
+#ifdef __AVX2__
+    constexpr static uint Lanes = sizeof(__m256i) / sizeof(uint);
+    __m256i load(uint i) const { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words.data() + i)); }
+#endif
+};
 
 namespace std {
 template <uint Size>
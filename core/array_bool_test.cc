@@ -0,0 +1,39 @@
+#include "core/array_bool.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <random>
+
+// Sizes below, at, and above one 256-bit vector, with and without scalar tail.
+template <uint Size>
+void TestCompare() {
+    std::mt19937_64 random(Size);
+    for (int iter = 0; iter < 1000; iter++) {
+        array_bool<Size> a, b;
+        for (int i = random() % 20; i > 0; i--) a.set(random() % Size);
+        b = a;
+        REQUIRE(a == b);
+        REQUIRE(a.contains(b));
+        REQUIRE(std::hash<array_bool<Size>>()(a) == std::hash<array_bool<Size>>()(b));
+
+        const int i = random() % Size;
+        if (a[i]) {
+            b.reset(i);
+            REQUIRE(!(a == b));
+            REQUIRE(a.contains(b));
+            REQUIRE(!b.contains(a));
+        } else {
+            b.set(i);
+            REQUIRE(!(a == b));
+            REQUIRE(!a.contains(b));
+            REQUIRE(b.contains(a));
+        }
+    }
+}
+
+TEST_CASE("array_bool compare") {
+    TestCompare<40>();
+    TestCompare<256>();
+    TestCompare<300>();
+    TestCompare<1024>();
+}
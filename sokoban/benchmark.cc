@@ -0,0 +1,73 @@
+#include "core/fmt.h"
+#include "core/string.h"
+
+#include "sokoban/solver.h"
+#include "sokoban/level_env.h"
+#include "sokoban/level_loader.h"
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+constexpr string_view kPrefix = "sokoban/levels/";
+
+// Solver throughput (states per second) for different number of threads.
+// Example: bazel run -c opt //sokoban:benchmark -- --levels microban1 --first 1 --last 100 --threads 1 8 16 32
+int main(int argc, char** argv) {
+    string levels = "microban1";
+    int first = 1;
+    int last = 0;
+    vector<int> threads = {1, 8, 16, 32};
+
+    SolverOptions options;
+    options.verbosity = 0;
+    options.monitor = false;
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("levels", po::value<string>(&levels), "")
+        ("first", po::value<int>(&first), "")
+        ("last", po::value<int>(&last), "")
+        ("threads", po::value<vector<int>>(&threads)->multitoken(), "")
+        ("dist_w", po::value<int>(&options.dist_w), "")
+        ("heur_w", po::value<int>(&options.heur_w), "")
+        ("matching_heuristic", po::value<bool>(&options.matching_heuristic), "")
+        ("max_time", po::value<int>(&options.max_time), "")
+        ("persistent_deadlocks", po::value<bool>(&options.persistent_deadlocks), "")
+        ("local_patterns", po::value<string>(&options.local_patterns), "")
+        ("compact_states", po::value<bool>(&options.compact_states), "")
+        ("verify_states", po::value<bool>(&options.verify_states), "")
+        ("queue_memory_mb", po::value<int>(&options.queue_memory_mb), "")
+        ("backward_threads", po::value<int>(&options.backward_threads), "")
+        ("tunnel_macros", po::value<bool>(&options.tunnel_macros), "")
+        ("goal_room_macros", po::value<bool>(&options.goal_room_macros), "")
+        ("pattern_db", po::value<bool>(&options.pattern_db), "")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    const string file = cat(kPrefix, levels);
+    if (last == 0) last = NumberOfLevels(file);
+
+    vector<const Level*> loaded;
+    for (int i = first; i <= last; i++) loaded.push_back(LoadLevel(format("{}:{}", file, i)));
+
+    print("{} {}-{}\n", levels, first, last);
+    print("threads   solved     states    seconds   states/s\n");
+    for (int t : threads) {
+        options.threads = t;
+        SolverStats total;
+        int solved = 0;
+        for (const Level* level : loaded) {
+            SolverStats stats = Benchmark(level, options);
+            total.states += stats.states;
+            total.elapsed_s += stats.elapsed_s;
+            if (stats.pushes > 0) solved += 1;
+        }
+        print("{:7} {:8} {:10} {:10.3f} {:10.0f}\n", t, solved, total.states, total.elapsed_s, total.states / total.elapsed_s);
+    }
+
+    for (const Level* level : loaded) Destroy(level);
+    return 0;
+}
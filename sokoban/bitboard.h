@@ -0,0 +1,136 @@
+#pragma once
+#include "core/bits_util.h"
+#include "core/exception.h"
+#include "sokoban/cell.h"
+#include "sokoban/common.h"
+
+// Level cells as a row-major bitset (bit index is Cell::xy), with a mask per direction of cells which have a neighbor
+// in that direction. Agent reachability is a flood fill of whole words: mask, shift, AND-NOT boxes, OR, until fixpoint.
+class Bitboard {
+public:
+    using Word = ulong;
+    constexpr static int WordBits = sizeof(Word) * 8;
+    constexpr static int InlineWords = 64;  // levels with up to 4096 buffer cells don't allocate
+
+    // Has words() words, once written by Bitboard (or cleared by clear()).
+    using Bits = small_vector<Word, InlineWords>;
+
+    Bitboard() {}
+
+    Bitboard(cspan<Cell*> cells, int num_alive, int buffer_size) : _words((buffer_size + WordBits - 1) / WordBits), _num_alive(num_alive) {
+        _xy_cell.resize(buffer_size, nullptr);
+        for (const Cell* c : cells) _xy_cell[c->xy] = c;
+        _alive_xy.resize(num_alive);
+        for (int i = 0; i < num_alive; i++) _alive_xy[i] = cells[i]->xy;
+
+        clear(_cells);
+        for (const Cell* c : cells) set(_cells, c->xy);
+        for (int d = 0; d < 4; d++) {
+            clear(_mask[d]);
+            _delta[d] = 0;
+            for (const Cell* c : cells) {
+                if (!c->dir(d)) continue;
+                set(_mask[d], c->xy);
+                _delta[d] = c->dir(d)->xy - c->xy;
+            }
+        }
+    }
+
+    int words() const { return _words; }
+    const Cell* cell(int xy) const { return _xy_cell[xy]; }
+    const Bits& cells() const { return _cells; }
+
+    static bool test(const Bits& bits, int xy) { return bits[xy / WordBits] & (Word(1) << (xy % WordBits)); }
+    static void set(Bits& bits, int xy) { bits[xy / WordBits] |= Word(1) << (xy % WordBits); }
+
+    void clear(Bits& bits) const { bits.assign(_words, 0); }
+
+    // Boxes are indexed by alive cell id.
+    template <typename Boxes>
+    void boxes(const Boxes& boxes, Bits& out) const {
+        clear(out);
+        const int box_words = (_num_alive + 31) / 32;
+        small_vector<uint, InlineWords * 2> packed(box_words);
+        boxes.pack(packed.data(), box_words);
+        for (int i = 0; i < box_words; i++)
+            for (uint w = packed[i]; w; w &= w - 1) set(out, _alive_xy[i * 32 + ctz(w)]);
+    }
+
+    // All cells agent can walk to from start without pushing any box.
+    void fill(int start, const Bits& boxes, Bits& out) const {
+        clear(out);
+        set(out, start);
+        // Updated in place, so propagation towards higher words can take several steps in one pass.
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int i = 0; i < _words; i++) {
+                Word w = out[i];
+                for (int d = 0; d < 4; d++) w |= shifted(out, d, i);
+                w &= ~boxes[i];
+                if (w != out[i]) {
+                    out[i] = w;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Cells in bits, and their neighbors in all 8 directions (as Cell::dir8).
+    void dilate8(const Bits& bits, Bits& out) const {
+        out.resize(_words);
+        for (int i = 0; i < _words; i++) {
+            Word w = bits[i];
+            for (int d = 0; d < 4; d++) w |= moved(bits, _delta[d], i) | moved(bits, _delta[d] + _delta[(d + 1) % 4], i);
+            out[i] = w & _cells[i];
+        }
+    }
+
+    // Cell with the lowest xy in bits.
+    const Cell* lowest(const Bits& bits) const {
+        for (int i = 0; i < _words; i++)
+            if (bits[i]) return _xy_cell[i * WordBits + ctz(bits[i])];
+        THROW(runtime_error, "empty bitboard");
+    }
+
+private:
+    // Word i of (bits & mask[d]) moved by delta[d].
+    Word shifted(const Bits& bits, int d, int i) const {
+        const int delta = _delta[d];
+        if (delta >= 0) {
+            const int q = delta / WordBits, r = delta % WordBits;
+            Word w = masked(bits, d, i - q) << r;
+            if (r) w |= masked(bits, d, i - q - 1) >> (WordBits - r);
+            return w;
+        }
+        const int q = -delta / WordBits, r = -delta % WordBits;
+        Word w = masked(bits, d, i + q) >> r;
+        if (r) w |= masked(bits, d, i + q + 1) << (WordBits - r);
+        return w;
+    }
+
+    Word masked(const Bits& bits, int d, int i) const { return (0 <= i && i < _words) ? bits[i] & _mask[d][i] : 0; }
+
+    // Word i of bits moved by delta, without masking (so it is by xy offset only).
+    Word moved(const Bits& bits, int delta, int i) const {
+        auto word = [&](int j) { return (0 <= j && j < _words) ? bits[j] : Word(0); };
+        if (delta >= 0) {
+            const int q = delta / WordBits, r = delta % WordBits;
+            Word w = word(i - q) << r;
+            if (r) w |= word(i - q - 1) >> (WordBits - r);
+            return w;
+        }
+        const int q = -delta / WordBits, r = -delta % WordBits;
+        Word w = word(i + q) >> r;
+        if (r) w |= word(i + q + 1) << (WordBits - r);
+        return w;
+    }
+
+    int _words = 0;
+    int _num_alive = 0;
+    Bits _cells;
+    array<Bits, 4> _mask;
+    array<int, 4> _delta;
+    vector<const Cell*> _xy_cell;
+    vector<int> _alive_xy;
+};
@@ -31,6 +31,25 @@ inline size_t hash(const vector<char>& a) {
     return hash;
 }
 
+// Zobrist key of box at cell index. Hash of boxes is XOR of keys of all boxes, so it can be updated in O(1).
+inline ulong zobrist(uint index) {
+    constexpr static uint TableSize = 1024;
+    static const array<ulong, TableSize> table = []() {
+        array<ulong, TableSize> t;
+        for (uint i = 0; i < TableSize; i++) t[i] = fmix64((ulong(i) + 1) * 0x9e3779b97f4a7c15ul);
+        return t;
+    }();
+    return (index < TableSize) ? table[index] : fmix64((ulong(index) + 1) * 0x9e3779b97f4a7c15ul);
+}
+
+// Same as hash() of boxes which were packed into words.
+inline ulong zobrist(const uint* words, int num_words) {
+    ulong hash = 0;
+    for (int w = 0; w < num_words; w++)
+        for (uint bits = words[w]; bits; bits &= bits - 1) hash ^= zobrist(w * 32 + __builtin_ctz(bits));
+    return hash;
+}
+
 struct DynamicBoxes {
     bool operator[](const Cell* a) const { return operator[](a->id); }
     void add(const Cell* a) { set(a->id); }
@@ -41,11 +60,23 @@ struct DynamicBoxes {
     void remove(uint index) { reset(index); }
 
     bool operator[](uint index) const { return index < data.size() && data[index]; }
-    void set(uint index) { if (index >= data.size()) data.resize(index + 1); data[index] = 1; }
-    void reset(uint index) { if (index < data.size()) data[index] = 0; }
-    void reset() { data.clear(); }
-    size_t hash() const { return ::hash(data); }
-    bool operator==(const DynamicBoxes& o) const { return equal(data, o.data); }
+    void set(uint index) {
+        if (index >= data.size()) data.resize(index + 1);
+        if (!data[index]) _hash ^= zobrist(index);
+        data[index] = 1;
+    }
+    void reset(uint index) {
+        if (index < data.size() && data[index]) _hash ^= zobrist(index);
+        if (index < data.size()) data[index] = 0;
+    }
+    void reset() { data.clear(); _hash = 0; }
+    size_t hash() const { return _hash; }
+    void pack(uint* out, int num_words) const {
+        std::fill(out, out + num_words, 0);
+        for (uint i = 0; i < std::min<size_t>(data.size(), num_words * 32); i++)
+            if (data[i]) out[i / 32] |= uint(1) << (i % 32);
+    }
+    bool operator==(const DynamicBoxes& o) const { return _hash == o._hash && equal(data, o.data); }
     bool contains(const DynamicBoxes& o) const { return ::contains(data, o.data); }
     template <typename Boxes>
     operator Boxes() const {
@@ -57,10 +88,15 @@ struct DynamicBoxes {
     void print() {}
    private:
     vector<char> data;
+    ulong _hash = 0;  // zobrist
 };
 
+// Up to 64 cells, hash is computed from the words when needed, instead of being stored. Stored hash would make
+// DenseBoxes<1> 16 bytes instead of 4, and states in queue and child batches 3x bigger.
 template <int Words>
 struct DenseBoxes {
+    constexpr static bool StoredHash = Words > 2;
+
     bool operator[](const Cell* a) const { return operator[](a->id); }
     void add(const Cell* a) { set(a->id); }
     void remove(const Cell* a) { reset(a->id); }
@@ -80,25 +116,49 @@ struct DenseBoxes {
 
     void set(uint index) {
         if (index >= data.size()) THROW(runtime_error, "out of range {} : {}", index, data.size());
+        if constexpr (StoredHash)
+            if (!data[index]) _hash ^= zobrist(index);
         data.set(index);
     }
 
     void reset(uint index) {
         if (index >= data.size()) THROW(runtime_error, "out of range");
+        if constexpr (StoredHash)
+            if (data[index]) _hash ^= zobrist(index);
         data.reset(index);
     }
 
-    void reset() { data.reset(); }
+    void reset() {
+        data.reset();
+        if constexpr (StoredHash) _hash = 0;
+    }
 
-    bool operator==(const DenseBoxes& o) const { return data == o.data; }
+    bool operator==(const DenseBoxes& o) const {
+        if constexpr (StoredHash)
+            if (_hash != o._hash) return false;
+        return data == o.data;
+    }
 
-    auto hash() const { return std::hash<decltype(data)>()(data); }
+    // O(1) with stored hash, as it is updated incrementally by set() and reset(). O(boxes) otherwise.
+    size_t hash() const {
+        if constexpr (StoredHash) return _hash;
+        return zobrist(data.words.data(), Words);
+    }
 
     bool contains(const DenseBoxes& o) const { return data.contains(o.data); }
 
+    // Copies the first num_words words (cells beyond num_alive are always empty).
+    void pack(uint* out, int num_words) const {
+        if (num_words > Words) THROW(runtime_error, "out of range {} : {}", num_words, Words);
+        std::copy(data.words.begin(), data.words.begin() + num_words, out);
+    }
+
     void print() {}
    private:
+    struct NoHash {};
+
     array_bool<32 * Words> data;
+    [[no_unique_address]] std::conditional_t<StoredHash, ulong, NoHash> _hash{};  // zobrist
 };
 
 using BigBoxes = DenseBoxes<32>;
@@ -0,0 +1,53 @@
+#include "core/exception.h"
+#include "core/fmt.h"
+#include "core/timestamp.h"
+
+#include "sokoban/state.h"
+
+#include <random>
+
+// Insert / lookup throughput of the same states stored with different DenseBoxes widths.
+// Example: bazel run -c opt //sokoban:boxes_benchmark -- 40
+template <int Words>
+void Benchmark(int alive, int boxes, int num_states) {
+    if (alive > 32 * Words) return;
+    using State = TState<DenseBoxes<Words>>;
+
+    std::mt19937_64 random(0);
+    vector<State> states(num_states);
+    for (State& s : states) {
+        s.agent = random() % alive;
+        for (int i = 0; i < boxes; i++) s.boxes.set(random() % alive);
+    }
+
+    Timestamp start_ts;
+    flat_hash_set<State> set;
+    for (const State& s : states) set.insert(s);
+    long found = 0;
+    for (const State& s : states) found += set.contains(s);
+    const double elapsed_s = start_ts.elapsed_s();
+    if (found != num_states) THROW(runtime_error, "missing states {}", found);
+    print("{:5} {:11} {:10.0f}\n", Words, sizeof(State), 2 * num_states / elapsed_s);
+}
+
+int main(int argc, char** argv) {
+    const int alive = (argc > 1) ? std::stoi(argv[1]) : 40;
+    const int boxes = (argc > 2) ? std::stoi(argv[2]) : 10;
+    constexpr int States = 1'000'000;
+
+    print("{} alive cells, {} boxes\n", alive, boxes);
+    print("words bytes/state   states/s\n");
+    // same widths as Solve() instantiates
+    Benchmark<1>(alive, boxes, States);
+    Benchmark<2>(alive, boxes, States);
+    Benchmark<3>(alive, boxes, States);
+    Benchmark<4>(alive, boxes, States);
+    Benchmark<5>(alive, boxes, States);
+    Benchmark<6>(alive, boxes, States);
+    Benchmark<8>(alive, boxes, States);
+    Benchmark<12>(alive, boxes, States);
+    Benchmark<16>(alive, boxes, States);
+    Benchmark<24>(alive, boxes, States);
+    Benchmark<32>(alive, boxes, States);
+    return 0;
+}
@@ -2,9 +2,6 @@
 #include "core/numeric.h"
 
 struct Level;
-struct Cell;
-
-using Exits = std::vector<std::tuple<const Cell*, const Cell*, int>>;
 
 struct Cell {
     const Level* level;
@@ -16,9 +13,9 @@ struct Cell {
 
     int goal_penalty = 0;
 
-    // TODO unused
-    int dead_region_id; // if alive then same as id, otherwise min id of all cells in dead region
-    Exits exits;
+    // Macro pushes (see ComputeTunnels and ComputeGoalRoom).
+    uchar tunnel = 0;        // bit (d & 1) is set if cell has walls on both sides across direction d
+    bool goal_room = false;  // inside of Level::goal_room_entrance
 
     std::array<Cell*, 4> _dir;
     Cell* dir(int d) const { return _dir[d & 3]; }
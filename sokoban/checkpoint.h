@@ -0,0 +1,89 @@
+#pragma once
+#include "core/bits_util.h"
+#include "core/exception.h"
+#include "core/fmt.h"
+#include "sokoban/level.h"
+#include "sokoban/util.h"
+
+#include <csignal>
+#include <fstream>
+
+// Checkpoints of running search are in /tmp/sokoban/checkpoints, one file per level (see Solver::Checkpoint).
+// File is written under temporary name and renamed once complete, so a crash while writing keeps the previous one.
+constexpr string_view kCheckpointPath = "/tmp/sokoban/checkpoints";
+constexpr ulong kCheckpointMagic = 0x0231'4b43'4f4b'4f53;  // "SOKOCK1" + version
+
+// Search depends on start state too, not only on the board (levels in the same file often share the board).
+inline ulong CheckpointHash(const Level* level) {
+    Agent agent = level->start_agent;
+    normalize(level, &agent, level->start_boxes);
+    return fmix64(level->hash() ^ fmix64(ulong(agent) + 1) ^ level->start_boxes.hash());
+}
+
+inline string CheckpointFilename(const Level* level) { return format("{}/{:016x}.bin", kCheckpointPath, CheckpointHash(level)); }
+
+template <typename T>
+void WritePod(std::ostream& out, const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T ReadPod(std::istream& in) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) THROW(runtime_error, "truncated checkpoint");
+    return value;
+}
+
+// Writes number of entries in front of entries written by fn (which returns their count).
+template <typename Fn>
+void WriteSection(std::ostream& out, const Fn& fn) {
+    const auto begin = out.tellp();
+    WritePod<long>(out, 0);
+    const long count = fn();
+    const auto end = out.tellp();
+    out.seekp(begin);
+    WritePod<long>(out, count);
+    out.seekp(end);
+}
+
+// State is written as agent and packed boxes, so that file doesn't depend on in-memory layout of Boxes.
+template <typename State>
+void WriteState(std::ostream& out, const State& s, int box_words) {
+    small_vector<uint, 8> words(box_words, 0);
+    s.boxes.pack(words.data(), box_words);
+    WritePod<uint>(out, s.agent);
+    out.write(reinterpret_cast<const char*>(words.data()), box_words * sizeof(uint));
+}
+
+template <typename State>
+State ReadState(std::istream& in, int box_words) {
+    State s;
+    s.agent = ReadPod<uint>(in);
+    for (int i = 0; i < box_words; i++)
+        for (uint w = ReadPod<uint>(in); w; w &= w - 1) s.boxes.set(i * 32 + ctz(w));
+    return s;
+}
+
+// Handler only sets the flag, checkpoint thread of solver polls it.
+inline atomic<bool> g_sigterm = false;
+
+// Installs the handler for its lifetime (only while checkpoint thread polls the flag), and restores previous one.
+class SigtermHandler {
+   public:
+    SigtermHandler() {
+        g_sigterm = false;
+        _previous = std::signal(SIGTERM, [](int) { g_sigterm = true; });
+    }
+    ~SigtermHandler() {
+        std::signal(SIGTERM, _previous);
+        // SIGTERM received after the last poll terminates the process, as it would without the handler.
+        if (g_sigterm.exchange(false)) std::raise(SIGTERM);
+    }
+    SigtermHandler(const SigtermHandler&) = delete;
+    SigtermHandler& operator=(const SigtermHandler&) = delete;
+
+   private:
+    void (*_previous)(int);
+};
@@ -10,40 +10,50 @@
 // if corral contains a goal (assuming num_boxes == num_goals) or one of its fence boxes isn't on goal
 // then that corral must be prioritized for push (ignoring all other corrals)
 
-constexpr int kCapacity = 2000;
-using Corral = static_vector<uchar, kCapacity>;  // avoid slower bit optimized vector<bool>
+// Corrals are bitsets by Cell::xy (as Bitboard), so that unions of corrals are a few word ORs.
+using Corral = Bitboard::Bits;
 
-bool is_single_component(const Level* level, const Corral& corral);
-
-inline void add(Corral& dest, const Corral& src) {
-    for (size_t i = 0; i < min(dest.size(), src.size()); i++)
-        if (src[i]) dest[i] = true;
+inline void add(const Level* level, Corral& dest, const Corral& src) {
+    for (int i = 0; i < level->bitboard.words(); i++) dest[i] |= src[i];
 }
 
+inline void clear(const Level* level, Corral& corral) { level->bitboard.clear(corral); }
+
+// Free areas (separated by boxes) are kept from previously processed state. If next state only has one box moved
+// (as popped child of expanded state often is), only areas around the old and new box positions are refilled.
 template <typename State>
 class Corrals {
    public:
     using Boxes = typename State::Boxes;
 
-    Corrals(const Level* level) : _level(level), _corral(level->cells.size()), _reachable(level->cells.size()) {}
+    Corrals(const Level* level) : _level(level) {
+        clear(level, _goal_bits);
+        for (const Cell* g : level->goals()) Bitboard::set(_goal_bits, g->xy);
+    }
     void find_unsolved_picorral(const State& s);
 
     bool has_picorral() const { return _has_picorral; }
     const Corral& picorral() const { return _picorral; }
+    bool in_picorral(const Cell* c) const { return Bitboard::test(_picorral, c->xy); }
     std::optional<Corral> opt_picorral() const {
         if (_has_picorral) return _picorral;
         return std::nullopt;
     }
 
    private:
+    void update_areas(const Bitboard::Bits& box_bits);
     void find_corrals(const State& s);
     void add_if_picorral(const Boxes& boxes);
 
     const Level* _level;
     Corral _corral;
     std::vector<std::pair<Corral, bool>> _corrals;
-    int _corrals_size;
-    std::vector<uchar> _reachable;
+    Bitboard::Bits _reachable;
+    Bitboard::Bits _goal_bits;
+
+    bool _valid = false;  // _box_bits and _areas are from previous state
+    Bitboard::Bits _box_bits;
+    std::vector<Bitboard::Bits> _areas;  // connected components of free cells
 
     bool _has_picorral;
     int _picorral_pushes;
@@ -53,7 +63,7 @@ class Corrals {
 template <typename State>
 void PrintWithCorral(const Level* level, const State& s, const std::optional<Corral>& corral) {
     Print(level, s.agent, s.boxes, [&](Cell* c) {
-        if (!corral.has_value() || !(*corral)[c->id]) return "";
+        if (!corral.has_value() || !Bitboard::test(*corral, c->xy)) return "";
         if (s.boxes[c->id]) return c->goal ? "🔷" : "⚪";
         if (c->goal) return "❔";
         if (!c->alive) return "❕";
@@ -62,10 +72,9 @@ void PrintWithCorral(const Level* level, const State& s, const std::optional<Cor
 }
 
 // corral with a goal without a box OR a box not on goal
-template <typename Boxes>
-bool is_unsolved_corral(const Level* level, const Boxes& boxes, const Corral& corral) {
-    for (Cell* a : level->alive())
-        if (corral[a->id] && a->goal != boxes[a->id]) return true;
+inline bool is_unsolved_corral(const Level* level, const Bitboard::Bits& box_bits, const Bitboard::Bits& goal_bits, const Corral& corral) {
+    for (int i = 0; i < level->bitboard.words(); i++)
+        if (corral[i] & (box_bits[i] ^ goal_bits[i])) return true;
     return false;
 }
 
@@ -73,69 +82,110 @@ bool is_unsolved_corral(const Level* level, const Boxes& boxes, const Corral& co
 // PI-Corral is an I-Corral where the player can perform all legal first pushes into the corral,
 // meaning the player can reach all the relevant boxes from all relevant directions.
 template <typename Boxes>
-bool is_picorral(const Level* level, const Boxes& boxes, const std::vector<uchar>& reachable, const Corral& corral,
-                 int& count) {
-    for (Cell* a : level->alive())
-        if (corral[a->id] && boxes[a->id])
-            for (auto [b, q] : a->pushes) {
-                if (!corral[b->id] && !corral[q->id]) return false;
-                if (!boxes[b->id] && corral[b->id] && !corral[q->id]) {
+bool is_picorral(const Level* level, const Boxes& boxes, const Bitboard::Bits& box_bits, const Bitboard::Bits& reachable, const Corral& corral, int& count) {
+    const LevelTables& t = level->tables;
+    const Bitboard& bitboard = level->bitboard;
+    auto in_corral = [&](int id) { return Bitboard::test(corral, level->cells[id]->xy); };
+    for (int i = 0; i < bitboard.words(); i++)
+        for (Bitboard::Word w = corral[i] & box_bits[i]; w; w &= w - 1) {
+            const Cell* a = bitboard.cell(i * Bitboard::WordBits + ctz(w));
+            for (int p = t.pushes_begin(a->id); p < t.pushes_end(a->id); p++) {
+                const int b = t.push_dest(p), q = t.push_src(p);
+                if (!in_corral(b) && !in_corral(q)) return false;
+                if (!boxes[b] && in_corral(b) && !in_corral(q)) {
                     count += 1;
-                    if (boxes[q->id]) {
-                        if (is_frozen_on_goal_simple(q, boxes)) continue;
+                    if (boxes[q]) {
+                        if (is_frozen_on_goal_simple(level->cells[q], boxes)) continue;
                         return false;
                     }
                     Boxes nboxes(boxes);
                     nboxes.reset(a->id);
-                    nboxes.set(b->id);
-                    if (is_simple_deadlock(b, nboxes)) continue;
-                    if (!reachable[q->id]) return false;
+                    nboxes.set(b);
+                    if (is_simple_deadlock(level->cells[b], nboxes)) continue;
+                    if (!Bitboard::test(reachable, level->cells[q]->xy)) return false;
                 }
             }
+        }
     return true;
 }
 
 template <typename State>
-void Corrals<State>::find_corrals(const State& s) {
-    AgentVisitor visitor(_level, s.agent);
-    for (auto& e : _reachable) e = false;
-    for (const Cell* a : visitor) {
-        _reachable[a->id] = true;
-        for (auto [_, b] : a->moves)
-            if (!s.boxes[b->id])
-                visitor.add(b);
+void Corrals<State>::update_areas(const Bitboard::Bits& box_bits) {
+    const Bitboard& bitboard = _level->bitboard;
+    const int words = bitboard.words();
+
+    // Cells to refill: everything, or areas next to box which was removed (B) and area of box which was added (C).
+    Bitboard::Bits remaining;
+    remaining.resize(words);
+    int changed = 0;
+    for (int i = 0; i < words; i++) changed += _valid ? popcount(_box_bits[i] ^ box_bits[i]) : 0;
+    if (_valid && changed == 0) return;
+    if (_valid && changed == 2) {
+        Bitboard::Bits around;
+        for (int i = 0; i < words; i++) remaining[i] = _box_bits[i] & ~box_bits[i];
+        bitboard.dilate8(remaining, around);
+        for (int i = 0; i < words; i++) around[i] |= box_bits[i] & ~_box_bits[i];
+
+        size_t kept = 0;
+        for (size_t j = 0; j < _areas.size(); j++) {
+            bool touched = false;
+            for (int i = 0; i < words; i++)
+                if (_areas[j][i] & around[i]) touched = true;
+            if (touched)
+                add(_level, remaining, _areas[j]);
             else
-                _reachable[b->id] = true;
+                _areas[kept++] = _areas[j];
+        }
+        _areas.resize(kept);
+    } else {
+        _areas.clear();
+        for (int i = 0; i < words; i++) remaining[i] = bitboard.cells()[i];
     }
+    for (int i = 0; i < words; i++) remaining[i] &= ~box_bits[i];
+    _box_bits = box_bits;
+    _valid = true;
+
+    // Cells of one area are all in remaining, as areas are only connected through freed cell B.
+    for (int i = 0; i < words; i++)
+        while (remaining[i]) {
+            Bitboard::Bits area;
+            bitboard.fill(i * Bitboard::WordBits + ctz(remaining[i]), box_bits, area);
+            for (int k = 0; k < words; k++) remaining[k] &= ~area[k];
+            _areas.push_back(area);
+        }
+    // same order as from scratch, so that ties between PI-corrals don't depend on previous state
+    std::sort(_areas.begin(), _areas.end(), [&](const Bitboard::Bits& a, const Bitboard::Bits& b) {
+        return bitboard.lowest(a)->xy < bitboard.lowest(b)->xy;
+    });
+}
+
+template <typename State>
+void Corrals<State>::find_corrals(const State& s) {
+    const Bitboard& bitboard = _level->bitboard;
+    Bitboard::Bits box_bits;
+    bitboard.boxes(s.boxes, box_bits);
+    update_areas(box_bits);
 
+    const int agent_xy = _level->cells[s.agent]->xy;
     _corrals.clear();
-    for (Cell* q : _level->cells)
-        if (!s.boxes[q->id] && !visitor.visited(q)) {
-            if (_level->cells.size() > kCapacity) THROW(runtime_error, "level has more cells ({}) than capacity ({})", _level->cells.size(), kCapacity);
-            static_vector<uchar, kCapacity> corral(_level->cells.size(), false);
-
-            visitor.add(q);
-            for (const Cell* a : visitor) {
-                corral[a->id] = true;
-
-                for (const Cell* b : a->dir8)
-                    if (b && !corral[b->id] && s.boxes[b->id]) corral[b->id] = true;
-
-                for (auto [_, b] : a->moves)
-                    if (!s.boxes[b->id])
-                        visitor.add(b);
-                    else
-                        corral[b->id] = true;
-            }
-            bool unsolved = is_unsolved_corral(_level, s.boxes, corral);
-            _corrals.emplace_back(std::move(corral), unsolved);
+    for (const Bitboard::Bits& area : _areas) {
+        if (Bitboard::test(area, agent_xy)) {
+            _reachable = area;
+            continue;
         }
+        // area, with boxes around it
+        Corral corral;
+        bitboard.dilate8(area, corral);
+        for (int i = 0; i < bitboard.words(); i++) corral[i] = area[i] | (corral[i] & box_bits[i]);
+        bool unsolved = is_unsolved_corral(_level, box_bits, _goal_bits, corral);
+        _corrals.emplace_back(corral, unsolved);
+    }
 }
 
 template <typename State>
 void Corrals<State>::add_if_picorral(const Boxes& boxes) {
     int pushes = 0;
-    if (is_picorral(_level, boxes, _reachable, _corral, /*out*/ pushes))
+    if (is_picorral(_level, boxes, _box_bits, _reachable, _corral, /*out*/ pushes))
         if (!_has_picorral || pushes < _picorral_pushes) {
             _picorral = _corral;
             _picorral_pushes = pushes;
@@ -163,13 +213,15 @@ void Corrals<State>::find_unsolved_picorral(const State& s) {
                 if (_corrals[a].second || _corrals[b].second) {
                     // generate subset from individual corrals
                     _corral = _corrals[a].first;
-                    add(_corral, _corrals[b].first);
+                    add(_level, _corral, _corrals[b].first);
                     add_if_picorral(s.boxes);
                 }
         // size all
-        for (auto& e : _corral) e = false;
-        FOR(i, _corrals.size()) add(_corral, _corrals[i].first);
-        if (is_unsolved_corral(_level, s.boxes, _corral)) add_if_picorral(s.boxes);
+        clear(_level, _corral);
+        FOR(i, _corrals.size()) add(_level, _corral, _corrals[i].first);
+        bool unsolved = false;
+        for (const auto& c : _corrals) unsolved |= c.second;
+        if (unsolved) add_if_picorral(s.boxes);
     } else {
         for (size_t subset = 1; subset < (1lu << _corrals.size()); subset++) {
             // subset must contain at least one unsolved corral
@@ -183,10 +235,10 @@ void Corrals<State>::find_unsolved_picorral(const State& s) {
             }
             if (!unsolved) continue;
 
-            for (auto& e : _corral) e = false;
+            clear(_level, _corral);
             FOR(i, _corrals.size()) {
                 size_t m = 1lu << i;
-                if ((subset & m) == m) add(_corral, _corrals[i].first);
+                if ((subset & m) == m) add(_level, _corral, _corrals[i].first);
             }
             add_if_picorral(s.boxes);
         }
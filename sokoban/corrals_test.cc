@@ -0,0 +1,37 @@
+#include "core/fmt.h"
+#include "sokoban/corrals.h"
+#include "sokoban/level_env.h"
+#include "sokoban/level_loader.h"
+#include "sokoban/random_walk.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+// Corrals reused along random walks (areas refilled incrementally) must find the same PI-corral as new Corrals for
+// each state (areas computed from scratch).
+TEST_CASE("Corrals incremental") {
+    using State = DynamicState;
+    std::mt19937 random(0);
+    long states = 0, picorrals = 0;
+    for (const string_view file : {"microban1", "original"}) {
+        const int num = NumberOfLevels(format("sokoban/levels/{}", file));
+        for (int i = 1; i <= num; i++) {
+            const Level* level = LoadLevel(format("sokoban/levels/{}:{}", file, i));
+            const int words = level->bitboard.words();
+            Corrals<State> incremental(level);
+            RandomWalks(level, 10, 50, random, [&](const State& s) {
+                Corrals<State> full(level);
+                incremental.find_unsolved_picorral(s);
+                full.find_unsolved_picorral(s);
+                REQUIRE(incremental.has_picorral() == full.has_picorral());
+                if (full.has_picorral()) {
+                    REQUIRE(std::equal(full.picorral().begin(), full.picorral().begin() + words, incremental.picorral().begin()));
+                    picorrals += 1;
+                }
+                states += 1;
+            });
+            Destroy(level);
+        }
+    }
+    REQUIRE(picorrals > 0);
+    REQUIRE(picorrals < states);
+}
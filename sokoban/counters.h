@@ -8,19 +8,26 @@ struct Counters {
     typedef ulong T;
 
     T simple_deadlocks = 0;
+    T local_deadlocks = 0;
     T db_deadlocks = 0;
     T frozen_box_deadlocks = 0;
     T heuristic_deadlocks = 0;
     T bipartite_deadlocks = 0;
     T corral_cuts = 0;
+    T macros = 0;  // children made by tunnel or goal room macro pushes
     T duplicates = 0;
     T updates = 0;
+    T lost_races = 0;  // new state inserted by other thread while this one was evaluating it
+    T heuristic_recomputes = 0;  // children whose heuristic couldn't be updated incrementally
+    T norm_incremental = 0;  // children normalized from reachable cells of parent
+    T norm_total = 0;
 
     // main ticks
     T queue_ticks = 0;
     T corral_ticks = 0;
     T state_ticks = 0;
     T is_simple_deadlock_ticks = 0;
+    T local_patterns_ticks = 0;
     T db_contains_pattern_ticks = 0;
     T contains_frozen_boxes_ticks = 0;
     T pattern_matches_ticks = 0;
@@ -32,6 +39,9 @@ struct Counters {
     T pattern_add_ticks = 0;
     T contains_box_blocked_goals_ticks = 0;
 
+    // overlaps with main ticks (deadlock checks and heuristic wasted on lost races)
+    T lost_race_ticks = 0;
+
     T total_ticks = 0;
 
     Counters() { memset(this, 0, sizeof(Counters)); }
@@ -42,6 +52,7 @@ struct Counters {
         a -= state_ticks;
         a -= corral_ticks;
         a -= is_simple_deadlock_ticks;
+        a -= local_patterns_ticks;
         a -= db_contains_pattern_ticks;
         a -= contains_frozen_boxes_ticks;
         a -= pattern_matches_ticks;
@@ -67,6 +78,7 @@ struct Counters {
         tick("state", state_ticks, &first);
         tick("corral", corral_ticks, &first);
         tick("is_simple_deadlock", is_simple_deadlock_ticks, &first);
+        tick("local_patterns", local_patterns_ticks, &first);
         tick("contains_pattern", db_contains_pattern_ticks, &first);
         tick("contains_frozen_boxes", contains_frozen_boxes_ticks, &first);
         tick("cfb: pattern_match", pattern_matches_ticks, &first);
@@ -78,8 +90,11 @@ struct Counters {
         tick("features", features_ticks, &first);
         tick("else", else_ticks(), &first);
 
-        ::print("\ndeadlocks (simple {}, db {}, frozen_box {}, bipartite {}, heuristic {})", simple_deadlocks, db_deadlocks, frozen_box_deadlocks, bipartite_deadlocks, heuristic_deadlocks);
-        ::print(", corral cuts {}, dups {}, updates {}\n", corral_cuts, duplicates, updates);
+        ::print("\ndeadlocks (simple {}, local {}, db {}, frozen_box {}, bipartite {}, heuristic {})", simple_deadlocks, local_deadlocks, db_deadlocks, frozen_box_deadlocks, bipartite_deadlocks, heuristic_deadlocks);
+        ::print(", corral cuts {}, macros {}, dups {}, updates {}", corral_cuts, macros, duplicates, updates);
+        ::print(", lost races {} ({:.1f}%)", lost_races, (lost_race_ticks * 100.0) / total_ticks);
+        ::print(", heuristic recomputes {}", heuristic_recomputes);
+        ::print(", incremental norm {:.1f}%\n", norm_total ? (norm_incremental * 100.0) / norm_total : 0.0);
     }
 
     void add(const Counters& src) {
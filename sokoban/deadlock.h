@@ -1,7 +1,17 @@
 #pragma once
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <filesystem>
+#include <fstream>
 #include <random>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "core/align_alloc.h"
+#include "sokoban/checkpoint.h"
 #include "sokoban/util.h"
 #include "sokoban/level.h"
+#include "sokoban/local_patterns.h"
 #include "sokoban/pair_visitor.h"
 #include "sokoban/counters.h"
 #include "sokoban/maximum_matching.h"
@@ -30,16 +40,11 @@ bool all_empty_goals_are_reachable(const Level* level, AgentVisitor& visitor, co
     return true;
 }
 
-// TODO simple heuristic: if goal is in tunnel (with bend) made of walls and frozen boxes, then goal is blocked
+// Concurrent memo of contains_box_blocked_goals() results, bounded to Shards * ShardCapacity entries.
+// Keys are spread over shards, each with its own lock and CLOCK eviction, so threads rarely wait for each other.
 template <typename Boxes>
-bool contains_box_blocked_goals(const Cell* agent, const Boxes& non_frozen, const Boxes& frozen) {
-    static mutex m;
-    unique_lock lock(m);
-
-    const Level* level = agent->level;
-    static AgentBoxVisitor visitor;
-    visitor.clear(level);
-
+class BoxBlockedGoalsCache {
+public:
     struct Key {
         int agent;
         Boxes non_frozen;
@@ -57,90 +62,175 @@ bool contains_box_blocked_goals(const Cell* agent, const Boxes& non_frozen, cons
         }
     };
 
-    static flat_hash_map<Key, bool, Hash> cache;
-    Key key{agent->id, non_frozen, frozen};
+    optional<bool> get(const Key& key, size_t hash) {
+        Shard& shard = _shards[hash >> (64 - ShardBits)];
+        unique_lock lock(shard.m);
+        auto it = shard.index.find(Probe{&key, hash});
+        if (it == shard.index.end()) return nullopt;
+        Entry& e = shard.entries[*it];
+        e.referenced = true;
+        return e.value;
+    }
+
+    void put(const Key& key, size_t hash, bool value) {
+        Shard& shard = _shards[hash >> (64 - ShardBits)];
+        unique_lock lock(shard.m);
+        if (shard.index.contains(Probe{&key, hash})) return;
+        if (shard.entries.size() < ShardCapacity) {
+            shard.entries.push_back({key, hash, value, false});
+            shard.index.insert(shard.entries.size() - 1);
+            return;
+        }
+
+        // CLOCK: evict first entry which wasn't referenced since hand last passed it
+        while (shard.entries[shard.hand].referenced) {
+            shard.entries[shard.hand].referenced = false;
+            shard.hand = (shard.hand + 1) % ShardCapacity;
+        }
+        shard.index.erase(shard.hand);
+        shard.entries[shard.hand] = {key, hash, value, false};
+        shard.index.insert(shard.hand);
+        shard.hand = (shard.hand + 1) % ShardCapacity;
+    }
+
+private:
+    // Shard is picked by high bits of hash, as flat_hash_set uses low bits of the same hash for control bytes.
+    constexpr static int ShardBits = 6;
+    constexpr static int Shards = 1 << ShardBits;
+    constexpr static uint ShardCapacity = 1024;
+
+    struct Entry {
+        Key key;
+        size_t hash;
+        bool value;
+        bool referenced;
+    };
+
+    // Lookup of key (with hash from caller) in index, without copying it into entries first.
+    struct Probe {
+        const Key* key;
+        size_t hash;
+    };
+
+    struct Shard;
+
+    // Index stores positions in entries, and hashes and compares them by their entries. Key is stored only once.
+    struct IndexHash {
+        using is_transparent = void;
+        const Shard* shard;
+        size_t operator()(uint i) const { return shard->entries[i].hash; }
+        size_t operator()(const Probe& p) const { return p.hash; }
+    };
+
+    struct IndexEq {
+        using is_transparent = void;
+        const Shard* shard;
+        bool operator()(uint a, uint b) const { return a == b; }
+        bool operator()(uint a, const Probe& p) const { return shard->entries[a].hash == p.hash && shard->entries[a].key == *p.key; }
+        bool operator()(const Probe& p, uint a) const { return (*this)(a, p); }
+    };
+
+    struct alignas(64) Shard {
+        mutex m;
+        vector<Entry> entries;
+        flat_hash_set<uint, IndexHash, IndexEq> index{0, IndexHash{this}, IndexEq{this}};  // positions in entries
+        uint hand = 0;
+    };
+
+    array<Shard, Shards> _shards;
+};
+
+// TODO simple heuristic: if goal is in tunnel (with bend) made of walls and frozen boxes, then goal is blocked
+template <typename Boxes>
+bool contains_box_blocked_goals(const Cell* agent, const Boxes& non_frozen, const Boxes& frozen, BoxBlockedGoalsCache<Boxes>& cache) {
+    using Cache = BoxBlockedGoalsCache<Boxes>;
+    const typename Cache::Key key{agent->id, non_frozen, frozen};
+    typename Cache::Hash hasher;
+    const size_t hash = hasher(key);
+    optional<bool> cached = cache.get(key, hash);
+    if (cached) return *cached;
 
-    auto it = cache.find(key);
-    if (it != cache.end()) return it->second;
+    const Level* level = agent->level;
+    const LevelTables& t = level->tables;
+    static thread_local PairVisitor visitor;
+    visitor.clear(level->cells.size(), level->num_alive);
 
-    for (Cell* g : level->goals()) {
+    for (const Cell* g : level->goals()) {
         if (frozen[g->id]) continue;
 
         visitor.clear();
         // Uses "moves" as this is reverse search
-        for (auto [_, e] : g->moves) {
-            if (!frozen[e->id]) visitor.add(e, g);
+        for (int m = t.moves_begin(g->id); m < t.moves_end(g->id); m++) {
+            const int e = t.move_cell(m);
+            if (!frozen[e]) visitor.add(e, g->id);
         }
 
         bool goal_reachable = false;
         for (auto [a, b] : visitor) {
-            if (a == agent && non_frozen[b->id]) {
+            if (a == agent->id && non_frozen[b]) {
                 goal_reachable = true;
                 break;
             }
 
             // Uses "moves" as this is reverse search
-            for (auto [d, n] : a->moves) {
-                if (frozen[n->id]) continue;
+            for (int m = t.moves_begin(a); m < t.moves_end(a); m++) {
+                const int n = t.move_cell(m);
+                if (frozen[n]) continue;
                 if (n != b) visitor.add(n, b); // move
-                if (a->dir(d ^ 2) && a->dir(d ^ 2) == b) visitor.add(n, a); // pull
+                if (t.dir(a, t.move_dir(m) ^ 2) == b) visitor.add(n, a); // pull
             }
         }
 
         if (!goal_reachable) {
-            cache.emplace(std::move(key), true);
+            cache.put(key, hash, true);
             return true;
         }
     }
 
-    cache.emplace(std::move(key), false);
+    cache.put(key, hash, false);
     return false;
 }
 
-// TODO: Index patterns by last pushed box (and push direction).
-
 // Thread-safe, and allows adding duplicate / redundant patterns!
+// Patterns are also indexed by alive cell, so that a query after pushing a box to C only needs to test patterns
+// which contain a box at C (any other matching pattern would have already matched parent state).
+//
+// Patterns are stored transposed in blocks of Lanes, with box words first and agent words last, so that full scan
+// can test whole block with one AVX2 instruction per word column (and reject it after the first few columns).
+// Without AVX2, full scan does the same with a loop over lanes.
 class Patterns {
     using Word = uint;
     constexpr static int WordBits = sizeof(Word) * 8;
+    constexpr static int BlockBytes = 32;  // one __m256i per column
+    constexpr static int Lanes = BlockBytes / sizeof(Word);
 public:
     Patterns(const Level* level)
         : _level(level)
         , _num_alive(level->alive().size())
         , _agent_words((_level->cells.size() + WordBits - 1) / WordBits)
-        , _box_words((_num_alive + WordBits - 1) / WordBits) {
-        _words.reserve((_agent_words + _box_words) * 64);
+        , _box_words((_num_alive + WordBits - 1) / WordBits)
+        , _by_box(_num_alive) {
+        _blocks.reserve((_agent_words + _box_words) * 64);
     }
 
+    // Tests all patterns.
     template <typename Boxes>
-    bool matches(const int agent, const Boxes& boxes, bool print_it = false) {
-        /*if (print_it) {
-            static mutex m;
-            unique_lock lock(m);
-            print("matches?\n");
-            Print(_level, TState<Boxes>(agent, boxes));
-        }*/
-
-        // TODO assume Boxes is always dense and avoid this conversion!
-        array<Word, 100> boxes_static;
-        vector<Word> boxes_dynamic;
-        Word* wboxes;
-        if (_num_alive <= boxes_static.size()) {
-            wboxes = boxes_static.data();
-        } else {
-            boxes_dynamic.resize(_num_alive, 0);
-            wboxes = boxes_dynamic.data();
-        }
+    bool matches(const int agent, const Boxes& boxes) {
+        Words wboxes(boxes, _box_words);
+        _mutex.lock_shared();
+        const bool found = scan(agent, wboxes.data);
+        _mutex.unlock_shared();
+        return found;
+    }
 
-        std::fill(wboxes, wboxes + _box_words, 0);
-        for (int i = 0; i < _num_alive; i++) {
-            if (boxes[i]) add_bit(wboxes, i);
-        }
+    // Tests only patterns with a box at pushed_box.
+    template <typename Boxes>
+    bool matches(const int agent, const Boxes& boxes, const Cell* pushed_box) {
+        Words wboxes(boxes, _box_words);
 
         _mutex.lock_shared();
-        const Word* end = _words.data() + _words.size();
-        for (const Word* p = _words.data(); p < end; p += _agent_words + _box_words) {
-            if (!matches_pattern(agent, wboxes, p)) continue;
+        for (uint i : _by_box[pushed_box->id]) {
+            if (!matches_pattern(agent, wboxes.data, i)) continue;
             _mutex.unlock_shared();
             return true;
         }
@@ -150,34 +240,53 @@ public:
 
     template <typename Boxes>
     void add(const int agent, const Boxes& boxes) {
-        _mutex.lock();
-        _words.resize(_words.size() + _agent_words + _box_words, 0);
-        Word* p = _words.data() + _words.size() - _agent_words - _box_words;
-        write_pattern(agent, boxes, p);
+        vector<Word> words(_agent_words + _box_words, 0);
+        write_pattern(agent, boxes, words.data());
 
-        /*Print(_level, TState(agent, boxes), [this, p](const Cell* e) {
-            if (e->id < _num_alive && has_bit(p + _agent_words, e->id)) return "🔵";
-            if (!has_bit(p, e->id)) return "▫️ ";
-            return "  ";
-        });*/
+        _mutex.lock();
+        const uint index = _size++;
+        if (index % Lanes == 0) _blocks.resize(_blocks.size() + block_size(), 0);
+        for (int c = 0; c < _box_words; c++) word(index, c) = words[_agent_words + c];
+        for (int c = 0; c < _agent_words; c++) word(index, _box_words + c) = words[c];
 
+        for (int i = 0; i < _num_alive; i++) {
+            if (boxes[i]) _by_box[i].push_back(index);
+        }
         _mutex.unlock();
     }
 
     size_t size() const {
         _mutex.lock_shared();
-        size_t size = _words.size() / (_agent_words + _box_words);
+        size_t size = _size;
         _mutex.unlock_shared();
         return size;
     }
 
+    // Patterns as (agent, box words) records, with agent being any cell of its agent region.
+    vector<Word> records() const {
+        vector<Word> out;
+        _mutex.lock_shared();
+        out.reserve(_size * (1 + _box_words));
+        for (uint p = 0; p < _size; p++) {
+            int agent = 0;
+            for (int c = 0; c < _agent_words; c++) {
+                if (word(p, _box_words + c) == 0) continue;
+                agent = c * WordBits + ctz(word(p, _box_words + c));
+                break;
+            }
+            out.push_back(agent);
+            for (int c = 0; c < _box_words; c++) out.push_back(word(p, c));
+        }
+        _mutex.unlock_shared();
+        return out;
+    }
+
     string summary() const {
         vector<int> count(100);
         _mutex.lock_shared();
-        const Word* end = _words.data() + _words.size();
-        for (const Word* p = _words.data(); p < end; p += _agent_words + _box_words) {
+        for (uint p = 0; p < _size; p++) {
             int b = 0;
-            for (int i = 0; i < _box_words; i++) b += popcount(p[_agent_words + i]);
+            for (int i = 0; i < _box_words; i++) b += popcount(word(p, i));
             count[b] += 1;
         }
         _mutex.unlock_shared();
@@ -187,12 +296,91 @@ public:
     }
 
 private:
-    bool matches_pattern(const int agent, const Word* boxes, const Word* p) {
-        if (!has_bit(p, agent)) return false;
+    // Boxes converted to pattern words.
+    struct Words {
+        array<Word, 100> boxes_static;
+        vector<Word> boxes_dynamic;
+        Word* data;
+
+        template <typename Boxes>
+        Words(const Boxes& boxes, int box_words) {
+            if (box_words <= boxes_static.size()) {
+                data = boxes_static.data();
+            } else {
+                boxes_dynamic.resize(box_words);
+                data = boxes_dynamic.data();
+            }
+            boxes.pack(data, box_words);
+        }
+    };
+
+    int block_size() const { return (_box_words + _agent_words) * Lanes; }
+
+    // Column 0 is the first box word and column _box_words is the first agent word.
+    Word& word(uint pattern, int column) { return _blocks[(pattern / Lanes) * block_size() + column * Lanes + pattern % Lanes]; }
+    Word word(uint pattern, int column) const { return _blocks[(pattern / Lanes) * block_size() + column * Lanes + pattern % Lanes]; }
+
+#ifdef __AVX2__
+    static __m256i load(const Word* block, int column) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(block + column * Lanes)); }
+
+    bool scan(const int agent, const Word* boxes) const {
+        const __m256i agent_bit = _mm256_set1_epi32(Word(1) << (agent % WordBits));
+        const int agent_column = _box_words + agent / WordBits;
+        const __m256i zero = _mm256_setzero_si256();
+
+        const Word* end = _blocks.data() + _blocks.size();
+        for (const Word* p = _blocks.data(); p < end; p += block_size()) {
+            // lanes with boxes missing from state
+            __m256i missing = zero;
+            int i = 0;
+            for (; i < _box_words; i++) {
+                missing = _mm256_or_si256(missing, _mm256_andnot_si256(_mm256_set1_epi32(boxes[i]), load(p, i)));
+                if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(missing, zero)) == 0) break;
+            }
+            if (i < _box_words) continue;
+
+            // Note: unused lanes of last block have empty agent words, so they never match.
+            const __m256i has_boxes = _mm256_cmpeq_epi32(missing, zero);
+            const __m256i no_agent = _mm256_cmpeq_epi32(_mm256_and_si256(load(p, agent_column), agent_bit), zero);
+            if (_mm256_movemask_epi8(_mm256_andnot_si256(no_agent, has_boxes)) != 0) return true;
+        }
+        return false;
+    }
+#else
+    // Same block scan as with AVX2, one lane at a time.
+    bool scan(const int agent, const Word* boxes) const {
+        const Word agent_bit = Word(1) << (agent % WordBits);
+        const int agent_column = _box_words + agent / WordBits;
+
+        const Word* end = _blocks.data() + _blocks.size();
+        for (const Word* p = _blocks.data(); p < end; p += block_size()) {
+            Word missing[Lanes] = {};
+            int i = 0;
+            for (; i < _box_words; i++) {
+                const Word* column = p + i * Lanes;
+                bool all_missing = true;
+                for (int lane = 0; lane < Lanes; lane++) {
+                    missing[lane] |= column[lane] & ~boxes[i];
+                    all_missing &= missing[lane] != 0;
+                }
+                if (all_missing) break;
+            }
+            if (i < _box_words) continue;
+
+            const Word* agents = p + agent_column * Lanes;
+            for (int lane = 0; lane < Lanes; lane++)
+                if (missing[lane] == 0 && (agents[lane] & agent_bit)) return true;
+        }
+        return false;
+    }
+#endif
+
+    bool matches_pattern(const int agent, const Word* boxes, uint pattern) const {
+        const Word agent_word = word(pattern, _box_words + agent / WordBits);
+        if ((agent_word & (Word(1) << (agent % WordBits))) == 0) return false;
 
-        const Word* pb = p + _agent_words;
         for (int i = 0; i < _box_words; i++) {
-            if ((boxes[i] | pb[i]) != boxes[i]) return false;
+            if ((boxes[i] | word(pattern, i)) != boxes[i]) return false;
         }
         return true;
     }
@@ -216,11 +404,6 @@ private:
         }
     }
 
-    static bool has_bit(const Word* p, int index) {
-        const Word mask = Word(1) << (index % WordBits);
-        return (p[index / WordBits] & mask) != 0;
-    }
-
     static void add_bit(Word* p, int index) {
         p[index / WordBits] |= Word(1) << (index % WordBits);
     }
@@ -231,7 +414,9 @@ private:
     const int _box_words;
 
     mutable shared_mutex _mutex;
-    vector<Word> _words;
+    uint _size = 0;
+    vector<Word, AlignAlloc<Word, BlockBytes>> _blocks;
+    vector<vector<uint>> _by_box;  // by alive cell id, indices of patterns with box at that cell
 };
 
 template <typename Boxes>
@@ -240,8 +425,15 @@ class DeadlockDB {
     constexpr static int WordBits = sizeof(Word) * 8;
 
 public:
-    DeadlockDB(const Level* level) : _level(level), _patterns(level) {
-
+    // If persistent, patterns found in previous runs on the same level are loaded, and new patterns are appended.
+    // Board-local patterns are loaded from local_patterns_dir (see LocalPatterns), none if it is empty.
+    DeadlockDB(const Level* level, bool persistent = false, string_view local_patterns_dir = "")
+            : _level(level), _box_words((level->num_alive + WordBits - 1) / WordBits), _patterns(level), _local_patterns(level, local_patterns_dir) {
+        if (!persistent) return;
+        std::filesystem::create_directories(kPatternsPath);
+        const string filename = patterns_filename(level);
+        load_patterns(filename);
+        _file.open(filename, std::ios_base::binary | std::ios_base::app);
     }
 
     void add_deadlock(const int agent, const Boxes& boxes) {
@@ -253,11 +445,16 @@ public:
             q.simple_deadlocks += 1;
             return true;
         }
-        return is_complex_deadlock(agent, boxes, q);
+        if (TIMER(_local_patterns.matches(agent, boxes, pushed_box), q.local_patterns_ticks)) {
+            q.local_deadlocks += 1;
+            return true;
+        }
+        return is_complex_deadlock(agent, boxes, q, pushed_box);
     }
 
-    bool is_complex_deadlock(const int agent, const Boxes& boxes, Counters& q) {
-        if (TIMER(_patterns.matches(agent, boxes), q.db_contains_pattern_ticks)) {
+    // If pushed_box is given, only patterns which contain it are tested.
+    bool is_complex_deadlock(const int agent, const Boxes& boxes, Counters& q, const Cell* pushed_box = nullptr) {
+        if (TIMER(pushed_box ? _patterns.matches(agent, boxes, pushed_box) : _patterns.matches(agent, boxes), q.db_contains_pattern_ticks)) {
             q.db_deadlocks += 1;
             return true;
         }
@@ -284,6 +481,7 @@ public:
 
                 if (!is_trivial_pattern(boxes_copy, num_boxes) && !solved(_level, boxes_copy)) {
                     _patterns.add(agent, boxes_copy);
+                    save_pattern(agent, boxes_copy);
                 }
             }
             q.pattern_add_ticks += ts.elapsed();
@@ -319,20 +517,88 @@ public:
                 num_boxes += 1;
             }
         }
-        return graph.maximum_matching() < _level->num_goals;
+        return graph.maximum_matching() < num_boxes;
     }
 
     size_t size() const { return _patterns.size(); }
 
+    // Writes number of patterns, followed by records (agent word and box words).
+    void save(std::ostream& out) const {
+        const vector<Word> records = _patterns.records();
+        WritePod<long>(out, records.size() / (1 + _box_words));
+        out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Word));
+    }
+
+    // Adds patterns written by save() which are not already known (they are also appended to the persistent file).
+    void load(std::istream& in) {
+        vector<Word> records(ReadPod<long>(in) * (1 + _box_words));
+        if (!in.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(Word))) THROW(runtime_error, "truncated checkpoint");
+        unique_lock<mutex> lock(_add_mutex);
+        for (const Word* p = records.data(); p < records.data() + records.size(); p += 1 + _box_words) {
+            const Boxes boxes = unpack_boxes(p + 1);
+            if (_patterns.matches(p[0], boxes)) continue;
+            _patterns.add(p[0], boxes);
+            save_pattern(p[0], boxes);
+        }
+    }
+
     string monitor() const {
-        return format("{} {}", _patterns.size(), _patterns.summary());
+        return format("{} {} local {}", _patterns.size(), _patterns.summary(), _local_patterns.size());
     }
 
 private:
+    constexpr static string_view kPatternsPath = "/tmp/sokoban/deadlocks";
+    constexpr static ulong kFileVersion = 2;
+
+    static string patterns_filename(const Level* level) { return format("{}/{:016x}.bin", kPatternsPath, level->hash()); }
+
+    // File is a sequence of records: checksum word, agent word, followed by box words. Bytes which don't start a record
+    // with valid checksum (incomplete record at the end, or torn or interleaved appends of concurrent processes) are
+    // skipped one at a time, until the next valid record.
     void load_patterns(const string_view filename) {
+        if (!std::filesystem::exists(filename) || std::filesystem::file_size(filename) == 0) return;
+        namespace bi = boost::interprocess;
+        bi::file_mapping file(string(filename).data(), bi::read_only);
+        bi::mapped_region region(file, bi::read_only);
+
+        const char* p = reinterpret_cast<const char*>(region.get_address());
+        const char* end = p + region.get_size();
+        vector<Word> record(2 + _box_words);
+        const size_t record_size = record.size() * sizeof(Word);
+        while (p + record_size <= end) {
+            std::memcpy(record.data(), p, record_size);
+            if (record[0] != checksum(record.data() + 1) || record[1] >= _level->cells.size()) {
+                p += 1;
+                continue;
+            }
+            _patterns.add(record[1], unpack_boxes(record.data() + 2));
+            p += record_size;
+        }
     }
 
+    // Of agent word and box words. Depends on number of alive cells, so files from other levels (or versions) don't match.
+    Word checksum(const Word* record) const {
+        ulong h = fmix64(kFileVersion ^ _level->num_alive);
+        for (int i = 0; i < 1 + _box_words; i++) h = fmix64(h ^ record[i]);
+        return Word(h);
+    }
+
+    Boxes unpack_boxes(const Word* words) const {
+        Boxes boxes;
+        for (int i = 0; i < _level->num_alive; i++)
+            if (words[i / WordBits] & (Word(1) << (i % WordBits))) boxes.set(i);
+        return boxes;
+    }
+
+    // Must be called with _add_mutex held.
     void save_pattern(const int agent, const Boxes& boxes) {
+        if (!_file.is_open()) return;
+        vector<Word> record(2 + _box_words);
+        record[1] = agent;
+        boxes.pack(record.data() + 2, _box_words);
+        record[0] = checksum(record.data() + 1);
+        _file.write(reinterpret_cast<const char*>(record.data()), record.size() * sizeof(Word));
+        _file.flush();
     }
 
     bool is_trivial_pattern(const Boxes& boxes, const int num_boxes) {
@@ -399,7 +665,7 @@ private:
 
                 boxes.reset(b->id);
                 boxes.set(c->id);
-                bool m = is_simple_deadlock(c, boxes) || TIMER(_patterns.matches(a->id, boxes, true), q.pattern_matches_ticks);
+                bool m = is_simple_deadlock(c, boxes) || TIMER(_patterns.matches(a->id, boxes, c), q.pattern_matches_ticks);
                 boxes.reset(c->id);
                 if (m) {
                     boxes.set(b->id);
@@ -427,7 +693,7 @@ private:
 
                 boxes.reset(b->id);
                 boxes.set(c->id);
-                bool m = is_simple_deadlock(c, boxes) || TIMER(_patterns.matches(a->id, boxes), q.pattern_matches_ticks);
+                bool m = is_simple_deadlock(c, boxes) || TIMER(_patterns.matches(a->id, boxes, c), q.pattern_matches_ticks);
                 boxes.reset(c->id);
                 if (m) {
                     boxes.set(b->id);
@@ -443,7 +709,7 @@ private:
 
         if (!solved(agent->level, boxes)) return {Result::Frozen, 5};
         if (!all_empty_goals_are_reachable(_level, visitor, boxes)) return {Result::BlockedGoal, 6};
-        if (TIMER(use_box_blocked_goals() && contains_box_blocked_goals(agent, orig_boxes, boxes), q.contains_box_blocked_goals_ticks)) {
+        if (TIMER(use_box_blocked_goals() && contains_box_blocked_goals(agent, orig_boxes, boxes, _box_blocked_goals_cache), q.contains_box_blocked_goals_ticks)) {
             _use_box_blocked_goals.store(true, std::memory_order_relaxed);
             return {Result::PushBlockedGoal, 7};
         }
@@ -465,6 +731,10 @@ private:
     atomic<bool> _use_bipartite = false;
 
     const Level* _level;
+    const int _box_words;
     mutex _add_mutex;
     Patterns _patterns;
+    LocalPatterns _local_patterns;
+    BoxBlockedGoalsCache<Boxes> _box_blocked_goals_cache;
+    std::ofstream _file;  // append only
 };
@@ -181,7 +181,7 @@ struct FestivalSolver {
     FestivalSolver(const Level* level, const SolverOptions& options)
             : options(options)
             , level(level)
-            , deadlock_db(level) {
+            , deadlock_db(level) {  // not persistent, as sub-puzzles change level geometry
         for (Cell* c : level->goals()) goals.set(c->id);
     }
 
@@ -252,7 +252,7 @@ struct FestivalSolver {
                 TIMER(corrals.find_unsolved_picorral(s), counters.corral_ticks);
                 for_each_push(level, s, [&](const Cell* a, const Cell* b, int d) {
                     const Cell* c = b->dir(d);
-                    if (TIMER(corrals.has_picorral() && !corrals.picorral()[c->id], counters.corral_ticks)) { counters.corral_cuts += 1; return; }
+                    if (TIMER(corrals.has_picorral() && !corrals.in_picorral(c), counters.corral_ticks)) { counters.corral_cuts += 1; return; }
 
                     State ns(b->id, s.boxes);
                     ns.boxes.move(b, c);
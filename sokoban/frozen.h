@@ -1,5 +1,6 @@
 #pragma once
 #include "core/auto.h"
+#include "core/murmur3.h"
 #include "core/numeric.h"
 #include "core/thread.h"
 
@@ -18,10 +19,14 @@ struct FrozenLevel {
     friend class FrozenLevels;
 };
 
+// Ready levels are also published to a fixed size lock-free table, so lookups of existing levels don't take m_mutex.
+// Table only holds pointers to levels owned by m_cache. Once it is half full, new levels are only in m_cache.
 class FrozenLevels {
    public:
     // thread safe (will block if level is currently being built)
     const FrozenLevel* Get(ulong frozen_boxes) /*const*/ {
+        if (auto ready = Find(frozen_boxes)) return ready;
+
         unique_lock g(m_mutex);
         while (true) {
             auto it = m_cache.find(frozen_boxes);
@@ -33,6 +38,8 @@ class FrozenLevels {
 
     // thread safe (if frozen level doesn't exist, builder will be called and new level inserted)
     const FrozenLevel* Get(ulong frozen_boxes, function<void(FrozenLevel& frozen)> builder) {
+        if (auto ready = Find(frozen_boxes)) return ready;
+
         unique_lock g(m_mutex);
         while (true) {
             auto it = m_cache.find(frozen_boxes);
@@ -46,6 +53,7 @@ class FrozenLevels {
                     builder(*ptr);
                 }
                 ptr->ready = true;
+                Publish(frozen_boxes, ptr);
                 m_cond.notify_all();
                 return ptr;
             }
@@ -64,7 +72,35 @@ class FrozenLevels {
             }*/
 
    private:
+    constexpr static uint ReadySlots = 4096;
+
+    // lock free, returns nullptr if level isn't in table (yet)
+    const FrozenLevel* Find(ulong frozen_boxes) const {
+        for (uint i = fmix64(frozen_boxes) % ReadySlots;; i = (i + 1) % ReadySlots) {
+            const FrozenLevel* frozen = m_ready[i].level.load(std::memory_order_acquire);
+            if (!frozen) return nullptr;
+            if (m_ready[i].key.load(std::memory_order_relaxed) == frozen_boxes) return frozen;
+        }
+    }
+
+    // Must hold m_mutex. Slots are never changed after level is stored, so readers can't see a torn entry.
+    void Publish(ulong frozen_boxes, const FrozenLevel* frozen) {
+        if (m_ready_count >= ReadySlots / 2) return;
+        m_ready_count += 1;
+        uint i = fmix64(frozen_boxes) % ReadySlots;
+        while (m_ready[i].level.load(std::memory_order_relaxed)) i = (i + 1) % ReadySlots;
+        m_ready[i].key.store(frozen_boxes, std::memory_order_relaxed);
+        m_ready[i].level.store(frozen, std::memory_order_release);
+    }
+
+    struct ReadySlot {
+        atomic<ulong> key = 0;
+        atomic<const FrozenLevel*> level = nullptr;
+    };
+
     flat_hash_map<ulong, unique_ptr<FrozenLevel>> m_cache;
+    array<ReadySlot, ReadySlots> m_ready;
+    uint m_ready_count = 0;
     mutable mutex m_mutex;
     mutable condition_variable m_cond;
 };
@@ -0,0 +1,55 @@
+#include "core/exception.h"
+#include "core/fmt.h"
+#include "core/thread.h"
+
+#include "sokoban/frozen.h"
+
+#include <random>
+#include <time.h>
+
+// CPU time of this thread, so that lookup cost is comparable when there are more threads than cores.
+static double ThreadSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// FrozenLevels::Get() cost for levels which are already built, for different number of threads.
+// With 1000 levels all lookups are in the lock-free table. With 8000 levels only first 2048 levels are in the table,
+// and lookups of the rest take the lock.
+// Example: bazel run -c opt //sokoban:frozen_benchmark -- 1 8 16 32
+int main(int argc, char** argv) {
+    vector<int> threads = {1, 2, 4, 8, 16, 32};
+    if (argc > 1) {
+        threads.clear();
+        for (int i = 1; i < argc; i++) threads.push_back(std::stoi(argv[i]));
+    }
+    constexpr long Lookups = 2'000'000;  // per thread
+
+    print("levels threads ns/lookup\n");
+    for (int levels : {1000, 8000}) {
+        FrozenLevels frozen_levels;
+        for (ulong key = 0; key < levels; key++) frozen_levels.Get(key, [](FrozenLevel& frozen) {});
+
+        for (int t : threads) {
+            mutex total_lock;
+            double total_seconds = 0;
+            atomic<long> found = 0;
+            parallel(t, [&](size_t thread_id) {
+                std::mt19937_64 random(thread_id);
+                long my_found = 0;
+                const double start = ThreadSeconds();
+                for (long i = 0; i < Lookups; i++) {
+                    if (frozen_levels.Get(random() % levels)) my_found += 1;
+                }
+                const double seconds = ThreadSeconds() - start;
+                found += my_found;
+                unique_lock lock(total_lock);
+                total_seconds += seconds;
+            });
+            if (found != Lookups * t) THROW(runtime_error, "missing frozen levels {}", found.load());
+            print("{:6} {:7} {:9.1f}\n", levels, t, total_seconds * 1e9 / (Lookups * t));
+        }
+    }
+    return 0;
+}
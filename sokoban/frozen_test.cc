@@ -0,0 +1,50 @@
+#include "core/thread.h"
+#include "sokoban/frozen.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+// Levels are built once, and the same level is returned by every lookup, whether it is in the lock-free table or not.
+TEST_CASE("FrozenLevels find and publish") {
+    constexpr ulong Levels = 5000;  // more than half of table slots, so the rest is only in m_cache
+    FrozenLevels frozen_levels;
+    REQUIRE(frozen_levels.Get(7) == nullptr);
+
+    vector<const FrozenLevel*> built(Levels);
+    for (ulong key = 0; key < Levels; key++) {
+        built[key] = frozen_levels.Get(key, [key](FrozenLevel& frozen) { frozen.cells.resize(key % 13); });
+        REQUIRE(built[key] != nullptr);
+        REQUIRE(built[key]->cells.size() == key % 13);
+    }
+    // Keys which collide in the table (same slot modulo table size) still find their own level.
+    for (ulong key = 0; key < Levels; key++) {
+        REQUIRE(frozen_levels.Get(key) == built[key]);
+        REQUIRE(frozen_levels.Get(key, [](FrozenLevel& frozen) { FAIL("built twice"); }) == built[key]);
+    }
+    REQUIRE(frozen_levels.Get(Levels) == nullptr);
+    REQUIRE(frozen_levels.Get(~0ul) == nullptr);
+}
+
+TEST_CASE("FrozenLevels concurrent get") {
+    constexpr ulong Levels = 3000;
+    FrozenLevels frozen_levels;
+    vector<atomic<int>> builds(Levels);
+    vector<atomic<const FrozenLevel*>> seen(Levels);
+    atomic<long> mismatches = 0;
+    parallel(8, [&](size_t thread_id) {
+        for (ulong i = 0; i < Levels; i++) {
+            const ulong key = (i * 7 + thread_id * 101) % Levels;
+            const FrozenLevel* frozen = frozen_levels.Get(key, [&](FrozenLevel& frozen) {
+                builds[key] += 1;
+                frozen.cells.resize(1);
+            });
+            const FrozenLevel* expected = nullptr;
+            if (!seen[key].compare_exchange_strong(expected, frozen) && expected != frozen) mismatches += 1;
+            if (frozen->cells.size() != 1) mismatches += 1;
+        }
+    });
+    REQUIRE(mismatches == 0);
+    for (ulong key = 0; key < Levels; key++) {
+        REQUIRE(builds[key] == 1);
+        REQUIRE(frozen_levels.Get(key) == seen[key]);
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "sokoban/hungarian.h"
 #include "sokoban/level.h"
+#include "sokoban/pattern_db.h"
 #include "sokoban/util.h"
 
 template<typename Boxes>
@@ -13,26 +14,272 @@ uint heuristic_simple(const Level* level, const Boxes& boxes) {
     return cost;
 }
 
+template<typename Boxes, typename DistFn>
+uint add_pattern_bonus(uint cost, const PatternDB* pattern_db, const Boxes& boxes, const DistFn& dist) {
+    if (!pattern_db || cost == Cell::Inf) return cost;
+    const uint bonus = pattern_db->bonus(boxes, dist);
+    return (bonus == Cell::Inf) ? Cell::Inf : cost + bonus;
+}
+
 // excludes frozen goals from costs
+// with pattern_db, adds interaction of pairs of boxes (see PatternDB::bonus)
 template<typename Boxes>
-uint heuristic(const Level* level, const Boxes& boxes) {
-    std::vector<uint> goal;  // TODO avoid this alloc
+uint heuristic(const Level* level, const Boxes& boxes, const PatternDB* pattern_db = nullptr) {
+    thread_local std::vector<uint> goal;
+    goal.clear();
     for (const Cell* g : level->goals())
         if (!boxes[g->id] || !is_frozen_on_goal_simple(g, boxes)) goal.push_back(g->id);
-    if (goal.size() == level->num_goals) return heuristic_simple(level, boxes);
+    if (goal.size() == level->num_goals)
+        return add_pattern_bonus(heuristic_simple(level, boxes), pattern_db, boxes, [](const Cell* box) { return box->min_push_distance; });
+
+    // min push distance out of all non-frozen goals, for every alive cell
+    thread_local std::vector<ushort> dist;
+    dist.assign(level->num_alive, LevelTables::Inf);
+    for (uint g : goal) level->tables.minimize_push_distance(g, dist.data());
 
     uint cost = 0;
     for (const Cell* box : level->alive()) {
         if (!boxes[box->id]) continue;
 
         if (!box->goal) {
-            // min push distance out of all non-frozen goals
-            uint dist = Cell::Inf;
-            for (uint i = 0; i < goal.size(); i++) minimize(dist, box->push_distance[goal[i]]);
-            if (dist == Cell::Inf) return Cell::Inf;
-            cost += dist;
+            if (dist[box->id] == LevelTables::Inf) return Cell::Inf;
+            cost += dist[box->id];
         }
         cost += box->goal_penalty;
     }
-    return cost;
+    return add_pattern_bonus(cost, pattern_db, boxes, [&](const Cell* box) { return box->goal ? 0u : uint(dist[box->id]); });
 }
+
+// Goals with boxes frozen on them (as in heuristic()) in parent state.
+// Frozen status of goal only depends on its 3x3 neighborhood, so push from B to C can only change goals around B and C.
+template<typename Boxes>
+class FrozenGoals {
+public:
+    FrozenGoals(const Level* level) : _level(level), _frozen(level->num_goals, false) {}
+
+    void set_parent(const Boxes& boxes) {
+        _count = 0;
+        for (const Cell* g : _level->goals()) {
+            _frozen[g->id] = boxes[g->id] && is_frozen_on_goal_simple(g, boxes);
+            _count += _frozen[g->id] ? 1 : 0;
+        }
+    }
+
+    bool operator[](int goal) const { return _frozen[goal]; }
+    int count() const { return _count; }
+
+    // Is set of frozen goals in child (with box pushed from B to C) different from parent?
+    bool changed(const Boxes& boxes, const Cell* b, const Cell* c) const { return changed(boxes, b) || changed(boxes, c); }
+
+private:
+    bool changed(const Boxes& boxes, const Cell* a) const {
+        if (changed_goal(boxes, a)) return true;
+        for (const Cell* e : a->dir8)
+            if (e && changed_goal(boxes, e)) return true;
+        return false;
+    }
+
+    bool changed_goal(const Boxes& boxes, const Cell* g) const {
+        if (!g->goal) return false;
+        return (boxes[g->id] && is_frozen_on_goal_simple(g, boxes)) != _frozen[g->id];
+    }
+
+    const Level* _level;
+    vector<bool> _frozen;  // by goal id
+    int _count = 0;
+};
+
+// Computes heuristic of children from heuristic of their parent, in O(1) if no goals are frozen.
+// Push from B to C only changes cost of that one box, unless set of frozen goals changes.
+template<typename Boxes>
+class IncrementalHeuristic {
+public:
+    IncrementalHeuristic(const Level* level, const PatternDB* pattern_db = nullptr)
+        : _level(level)
+        , _pattern_db(pattern_db)
+        , _frozen(level)
+        , _distance(level->num_alive, LevelTables::Inf)
+        , _distance_frozen(level->num_goals, false) {
+        for (const Cell* g : level->goals()) level->tables.minimize_push_distance(g->id, _distance.data());
+    }
+
+    // Must be called before push() for children of new parent state.
+    // O(num_goals), plus O(num_alive) for every goal which is frozen in only one of this and previous parent with any
+    // frozen goals (or O(num_goals * num_alive) with pattern_db).
+    void set_parent(const Boxes& boxes, uint heuristic) {
+        _heuristic = _pattern_db ? ::heuristic(_level, boxes) : heuristic;
+        _frozen.set_parent(boxes);
+        if (_frozen.count() == 0) return;
+        update_distance();
+    }
+
+    // Heuristic of child state (with box pushed from B to C). Same result as heuristic(level, boxes, pattern_db).
+    // Pattern bonus is always computed from scratch, in O(num_boxes^2).
+    uint push(const Boxes& boxes, const Cell* b, const Cell* c) {
+        if (_heuristic == Cell::Inf || !c->alive || _frozen.changed(boxes, b, c)) {
+            _full_updates += 1;
+            return heuristic(_level, boxes, _pattern_db);
+        }
+        uint cost_c = cost(c);
+        if (cost_c == Cell::Inf) return Cell::Inf;
+        return add_pattern_bonus(_heuristic - cost(b) + cost_c, _pattern_db, boxes, [&](const Cell* box) { return cost(box) - box->goal_penalty; });
+    }
+
+    // Number of push() calls which had to fall back to heuristic().
+    long full_updates() const { return _full_updates; }
+
+private:
+    // Updates _distance from set of frozen goals it was computed for to current one. Goals which are no longer frozen
+    // are added by minimizing, and cells whose nearest goal became frozen are recomputed from all non-frozen goals.
+    void update_distance() {
+        const LevelTables& t = _level->tables;
+        _unfrozen.clear();
+        _newly_frozen.clear();
+        for (const Cell* g : _level->goals()) {
+            if (_frozen[g->id] == _distance_frozen[g->id]) continue;
+            (_frozen[g->id] ? _newly_frozen : _unfrozen).push_back(g->id);
+            _distance_frozen[g->id] = _frozen[g->id];
+        }
+
+        for (const Cell* a : _level->alive()) {
+            ushort& dist = _distance[a->id];
+            bool stale = false;
+            for (int g : _newly_frozen) stale |= dist != LevelTables::Inf && t.push_distance(g, a->id) == dist;
+            if (!stale) continue;
+            dist = LevelTables::Inf;
+            for (const Cell* g : _level->goals())
+                if (!_frozen[g->id]) dist = std::min(dist, t.push_distance(g->id, a->id));
+        }
+        for (int g : _unfrozen) t.minimize_push_distance(g, _distance.data());
+    }
+
+    // Cost of one box in heuristic() given current set of frozen goals.
+    uint cost(const Cell* box) const {
+        if (_frozen.count() == 0) return box->min_push_distance + box->goal_penalty;
+        if (box->goal) return box->goal_penalty;
+        const ushort dist = _distance[box->id];
+        if (dist == LevelTables::Inf) return Cell::Inf;
+        return dist + box->goal_penalty;
+    }
+
+    const Level* _level;
+    const PatternDB* _pattern_db;
+    FrozenGoals<Boxes> _frozen;
+    vector<ushort> _distance;  // min push distance to goals which are not in _distance_frozen, by alive cell
+    vector<bool> _distance_frozen;  // by goal id
+    vector<int> _unfrozen, _newly_frozen;  // goal ids, reused by update_distance()
+    uint _heuristic = 0;  // of parent, without pattern bonus
+    long _full_updates = 0;
+};
+
+// Lower bound from min cost matching of boxes to goals using push distances (instead of each box going to its
+// nearest goal). Boxes which are frozen on goals can only be matched to their own goal.
+//
+// set_parent() solves the matching once per expanded state, and push() repairs only the row of the pushed box.
+// When set of frozen goals changes, push() solves the child from scratch in a separate Hungarian matrix, so the
+// parent solution stays valid for the remaining children.
+template<typename Boxes>
+class MatchingHeuristic {
+public:
+    MatchingHeuristic(const Level* level)
+        : _level(level)
+        , _hungarian(level->num_goals)
+        , _scratch(level->num_goals)
+        , _frozen(level)
+        , _scratch_frozen(level)
+        , _cell_row(level->num_alive, -1)
+        , _scratch_box(level->num_goals, nullptr) {}
+
+    // Heuristic of state without parent. Doesn't change parent. O(num_goals^3)
+    uint full(const Boxes& boxes) {
+        const int num_goals = _level->num_goals;
+        _scratch_frozen.set_parent(boxes);
+        int row = 0;
+        for (const Cell* box : _level->alive()) {
+            if (!boxes[box->id]) continue;
+            if (row == num_goals) THROW(runtime_error, "more boxes than goals");
+            _scratch_box[row] = box;
+            for (const Cell* g : _level->goals()) _scratch.costs(row, g->id) = cost(box, g, _scratch_frozen);
+            row += 1;
+        }
+        for (int r = row; r < num_goals; r++)
+            for (int g = 0; g < num_goals; g++) _scratch.costs(r, g) = 0;
+
+        // execute() overwrites costs, so cost of assignment is computed again from cells
+        const vector<int>& assignment = _scratch.execute();
+        long sum = 0;
+        for (const Cell* g : _level->goals()) {
+            const int r = assignment[g->id];
+            if (r < row) sum += cost(_scratch_box[r], g, _scratch_frozen);
+        }
+        return result(sum);
+    }
+
+    // Must be called before push() for children of new parent state. O(num_goals^3)
+    void set_parent(const Boxes& boxes) {
+        init(boxes);
+        _hungarian.solve();
+        _hungarian.save(_parent);
+        _parent_valid = true;
+    }
+
+    // Heuristic of child state (with box pushed from B to C). O(num_goals^2), or O(num_goals^3) if set of frozen
+    // goals changes.
+    uint push(const Boxes& boxes, const Cell* b, const Cell* c) {
+        if (!_parent_valid || !c->alive || _frozen.changed(boxes, b, c)) {
+            _full_updates += 1;
+            return full(boxes);
+        }
+        int row = _cell_row[b->id];
+        set_row(row, c);
+        _hungarian.restore(_parent);
+        long cost = _hungarian.repair(row);
+        set_row(row, b);
+        return result(cost);
+    }
+
+    // Number of push() calls which had to fall back to full().
+    long full_updates() const { return _full_updates; }
+
+private:
+    constexpr static int InfCost = 1 << 20;
+
+    void init(const Boxes& boxes) {
+        const int num_goals = _level->num_goals;
+        _frozen.set_parent(boxes);
+        int row = 0;
+        for (const Cell* box : _level->alive()) {
+            _cell_row[box->id] = -1;
+            if (!boxes[box->id]) continue;
+            if (row == num_goals) THROW(runtime_error, "more boxes than goals");
+            _cell_row[box->id] = row;
+            set_row(row++, box);
+        }
+        // extra goals (if any) are matched to dummy boxes at no cost
+        for (; row < num_goals; row++)
+            for (int g = 0; g < num_goals; g++) _hungarian.costs(row, g) = 0;
+    }
+
+    void set_row(int row, const Cell* a) {
+        for (const Cell* g : _level->goals()) _hungarian.costs(row, g->id) = cost(a, g, _frozen);
+    }
+
+    // Cost of box at cell A to goal G. Includes goal penalty, so that heuristic() and this have same scale.
+    int cost(const Cell* a, const Cell* g, const FrozenGoals<Boxes>& frozen) const {
+        const ushort dist = _level->tables.push_distance(g->id, a->id);
+        bool blocked = dist == LevelTables::Inf || (frozen[g->id] && a != g);
+        return blocked ? InfCost : dist + a->goal_penalty;
+    }
+
+    uint result(long cost) const { return (cost >= InfCost) ? Cell::Inf : cost; }
+
+    const Level* _level;
+    IncrementalHungarian _hungarian;  // of parent
+    IncrementalHungarian::Solution _parent;
+    bool _parent_valid = false;
+    Hungarian _scratch;  // for full()
+    FrozenGoals<Boxes> _frozen, _scratch_frozen;
+    vector<int> _cell_row;  // by alive cell id (-1 if no box)
+    vector<const Cell*> _scratch_box;  // by row of _scratch
+    long _full_updates = 0;
+};
@@ -267,3 +267,100 @@ struct Hungarian {
         }
     }
 };
+
+// Min cost assignment using dual potentials and shortest augmenting paths (Jonker-Volgenant style).
+//
+// solve() is O(n^3). After costs of a single row change, repair(row) re-inserts only that row into an existing
+// optimal assignment in O(n^2). Reduced costs of all other rows stay non-negative, so the result is optimal again.
+// save() and restore() copy only assignment and potentials, so many repairs can start from the same solution.
+struct IncrementalHungarian {
+    matrix<int> costs;  // costs(row, col), must be in range [0, numeric_limits<int>::max() / (2 * dim)]
+
+    struct Solution {
+        vector<int> u, v;     // potentials of rows and cols (1-based, index 0 is unused)
+        vector<int> col_row;  // 1-based row assigned to 1-based col (0 if none)
+    };
+
+    IncrementalHungarian(int dim) : dim(dim) {
+        if (dim > numeric_limits<short>::max()) THROW(invalid_argument);
+        costs.resize(dim, dim);
+        s.u.resize(dim + 1);
+        s.v.resize(dim + 1);
+        s.col_row.resize(dim + 1);
+        min_v.resize(dim + 1);
+        way.resize(dim + 1);
+        used.resize(dim + 1);
+    }
+
+    // Returns cost of optimal assignment.
+    long solve() {
+        std::fill(s.u.begin(), s.u.end(), 0);
+        std::fill(s.v.begin(), s.v.end(), 0);
+        std::fill(s.col_row.begin(), s.col_row.end(), 0);
+        for (int i = 1; i <= dim; i++) insert(i);
+        return cost();
+    }
+
+    // Call after changing costs of row. Returns cost of optimal assignment.
+    long repair(int row) {
+        for (int j = 1; j <= dim; j++)
+            if (s.col_row[j] == row + 1) s.col_row[j] = 0;
+        s.u[row + 1] = 0;
+        insert(row + 1);
+        return cost();
+    }
+
+    void save(Solution& out) const { out = s; }
+    void restore(const Solution& in) { s = in; }
+
+   private:
+    long cost() const {
+        long sum = 0;
+        for (int j = 1; j <= dim; j++) sum += costs(s.col_row[j] - 1, j - 1);
+        return sum;
+    }
+
+    // Finds shortest augmenting path from free row i (1-based) and flips it. O(n^2)
+    void insert(int i) {
+        auto& [u, v, p] = s;
+        p[0] = i;
+        int j0 = 0;
+        std::fill(min_v.begin(), min_v.end(), numeric_limits<int>::max());
+        std::fill(used.begin(), used.end(), false);
+        do {
+            used[j0] = true;
+            int i0 = p[j0], delta = numeric_limits<int>::max(), j1 = 0;
+            for (int j = 1; j <= dim; j++)
+                if (!used[j]) {
+                    int cur = costs(i0 - 1, j - 1) - u[i0] - v[j];
+                    if (cur < min_v[j]) {
+                        min_v[j] = cur;
+                        way[j] = j0;
+                    }
+                    if (min_v[j] < delta) {
+                        delta = min_v[j];
+                        j1 = j;
+                    }
+                }
+            for (int j = 0; j <= dim; j++)
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    min_v[j] -= delta;
+                }
+            j0 = j1;
+        } while (p[j0] != 0);
+        do {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    int dim;
+    Solution s;
+    vector<int> min_v;
+    vector<int> way;
+    vector<uchar> used;
+};
@@ -0,0 +1,66 @@
+#include "sokoban/hungarian.h"
+#include <random>
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+static long BruteForce(const matrix<int>& costs, int dim) {
+    vector<int> perm(dim);
+    for (int i = 0; i < dim; i++) perm[i] = i;
+    long best = numeric_limits<long>::max();
+    do {
+        long sum = 0;
+        for (int i = 0; i < dim; i++) sum += costs(i, perm[i]);
+        best = std::min(best, sum);
+    } while (std::next_permutation(perm.begin(), perm.end()));
+    return best;
+}
+
+TEST_CASE("Hungarian", "") {
+    std::mt19937 rnd(0);
+    for (int dim = 1; dim <= 7; dim++)
+        for (int k = 0; k < 50; k++) {
+            Hungarian h(dim);
+            for (int i = 0; i < dim; i++)
+                for (int j = 0; j < dim; j++) h.costs(i, j) = rnd() % 20;
+            const matrix<int> costs = h.costs;  // execute() changes costs
+            const vector<int>& assignment = h.execute();
+            long sum = 0;
+            for (int j = 0; j < dim; j++) sum += costs(assignment[j], j);
+            REQUIRE(sum == BruteForce(costs, dim));
+        }
+}
+
+TEST_CASE("IncrementalHungarian solve", "") {
+    std::mt19937 rnd(0);
+    for (int dim = 1; dim <= 7; dim++)
+        for (int k = 0; k < 50; k++) {
+            IncrementalHungarian h(dim);
+            for (int i = 0; i < dim; i++)
+                for (int j = 0; j < dim; j++) h.costs(i, j) = rnd() % 20;
+            REQUIRE(h.solve() == BruteForce(h.costs, dim));
+        }
+}
+
+TEST_CASE("IncrementalHungarian repair", "") {
+    std::mt19937 rnd(0);
+    for (int dim = 1; dim <= 7; dim++) {
+        IncrementalHungarian h(dim);
+        for (int i = 0; i < dim; i++)
+            for (int j = 0; j < dim; j++) h.costs(i, j) = rnd() % 20;
+        h.solve();
+        IncrementalHungarian::Solution parent;
+        h.save(parent);
+
+        for (int k = 0; k < 50; k++) {
+            int row = rnd() % dim;
+            vector<int> old(dim);
+            for (int j = 0; j < dim; j++) {
+                old[j] = h.costs(row, j);
+                h.costs(row, j) = rnd() % 20;
+            }
+            h.restore(parent);
+            REQUIRE(h.repair(row) == BruteForce(h.costs, dim));
+            for (int j = 0; j < dim; j++) h.costs(row, j) = old[j];
+        }
+    }
+}
@@ -1,7 +1,10 @@
 #pragma once
+#include "core/murmur3.h"
 #include "sokoban/common.h"
 #include "sokoban/cell.h"
 #include "sokoban/boxes.h"
+#include "sokoban/bitboard.h"
+#include "sokoban/level_tables.h"
 
 struct Level {
     string name;
@@ -16,6 +19,9 @@ struct Level {
     cspan<Cell*> goals() const { return cspan<Cell*>(cells.data(), num_goals); }
 
     vector<Cell*> goals_in_packing_order;
+    // Only way into area with all goals (or null if there is no such area), and order in which macros fill the goals.
+    const Cell* goal_room_entrance = nullptr;
+    vector<const Cell*> goal_room_order;
 
     int num_goals;
     int num_alive;
@@ -24,6 +30,9 @@ struct Level {
     Agent start_agent;
     DynamicBoxes start_boxes;
 
+    Bitboard bitboard;
+    LevelTables tables;
+
     const Cell* cell_by_xy(int xy) const {
         for (const Cell* cell : cells) if (cell->xy == xy) return cell;
         THROW(runtime_error, "cell not found");
@@ -33,6 +42,10 @@ struct Level {
     const Cell* cell_by_xy(int2 pos) const { return cell_by_xy(pos.x, pos.y); }
 
     int2 cell_to_vec(const Cell* cell) const { return {cell->xy % width, cell->xy / width}; }
+
+    // Hash of the board only: walls, goals, sinks and dead cells (cell ids are deterministic for given buffer). Start
+    // agent and boxes are not included, as levels with the same board share deadlocks and pattern database.
+    size_t hash() const { return MurmurHash3_x64_128(buffer.data(), buffer.size(), width); }
 };
 
 inline Cell* GetCell(const Level* level, uint xy) {
@@ -85,11 +85,14 @@ void LevelEnv::Reset(int rows, int cols) {
 }
 
 void LevelEnv::Load(string_view filename) {
-    name = filename;
     auto lines = LoadLevelLines(filename);
+    Parse(vector<string_view>(lines.begin(), lines.end()));
+    name = filename;
+}
 
+void LevelEnv::Parse(const vector<string_view>& lines) {
     int cols = 0;
-    for (const string& s : lines) cols = std::max(cols, int(s.size()));
+    for (string_view s : lines) cols = std::max(cols, int(s.size()));
     int rows = lines.size();
 
     Reset(rows, cols);
@@ -1,6 +1,7 @@
 #pragma once
 #include "core/matrix.h"
 #include <string_view>
+#include <vector>
 
 struct LevelEnv {
     std::string name;
@@ -14,6 +15,7 @@ struct LevelEnv {
 
     void Reset(int rows, int cols);
     void Load(std::string_view filename);
+    void Parse(const std::vector<std::string_view>& lines);  // rows of level in file format
     bool IsValid() const; // Valid doesn't imply solvable!
     void Print(bool edge = true) const;
     void Unprint() const;
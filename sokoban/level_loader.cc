@@ -6,6 +6,7 @@
 
 #include "sokoban/level_loader.h"
 #include "sokoban/util.h"
+#include "sokoban/macros.h"
 #include "sokoban/level_env.h"
 
 namespace Code {
@@ -392,12 +393,125 @@ void ComputeGoalPenalties(Level* level) {
     });
 }
 
+// Tunnel must be one-way: agent can't walk around the cell from one of its ends to the other. Box in it then splits
+// the level, and can only be pushed on in the direction it came from.
+void ComputeTunnels(Level* level) {
+    vector<char> visited(level->cells.size());
+    vector<const Cell*> queue;
+    auto bypass = [&](const Cell* c, const Cell* from, const Cell* to) {
+        if (!from || !to) return false;
+        std::fill(visited.begin(), visited.end(), 0);
+        visited[c->id] = 1;
+        visited[from->id] = 1;
+        queue = {from};
+        for (int i = 0; i < queue.size(); i++)
+            for (auto [_, n] : queue[i]->moves) {
+                if (n == to) return true;
+                if (visited[n->id]) continue;
+                visited[n->id] = 1;
+                queue.push_back(n);
+            }
+        return false;
+    };
+    for (Cell* c : level->cells)
+        for (int d = 0; d < 2; d++)
+            if (!c->dir(d + 1) && !c->dir(d - 1) && !bypass(c, c->dir(d), c->dir(d + 2))) c->tunnel |= 1 << d;
+}
+
+// Goal room is area with all goals (and no boxes or agent at start) which is only connected to the rest of level
+// through one alive cell (entrance). If there are several, the smallest room is used.
+void ComputeGoalRoom(Level* level) {
+    if (level->num_goals == 0) return;
+    const Cell* best = nullptr;
+    vector<Cell*> best_room;
+    vector<char> visited(level->cells.size());
+    for (const Cell* e : level->alive()) {
+        if (e->goal) continue;
+        std::fill(visited.begin(), visited.end(), 0);
+        visited[e->id] = 1;
+        visited[level->goals()[0]->id] = 1;
+        vector<Cell*> room = {level->goals()[0]};
+        for (int i = 0; i < room.size(); i++)
+            for (auto [_, n] : room[i]->moves)
+                if (!visited[n->id]) {
+                    visited[n->id] = 1;
+                    room.push_back(n);
+                }
+
+        if (level->start_agent != e->id && visited[level->start_agent]) continue;
+        if (best && room.size() >= best_room.size()) continue;
+        bool valid = true;
+        for (const Cell* g : level->goals())
+            if (!visited[g->id]) valid = false;
+        for (const Cell* c : room)
+            if (c->alive && level->start_boxes[c->id]) valid = false;
+        if (!valid) continue;
+        best = e;
+        best_room = std::move(room);
+    }
+
+    if (!best) return;
+    for (Cell* c : best_room) c->goal_room = true;
+
+    // Order in which goals are filled is found backwards: last goal is one that a box can be pushed to from entrance
+    // while all other goals are filled, and so on (preferring goals late in goals_in_packing_order).
+    DynamicBoxes filled;
+    for (const Cell* g : level->goals()) filled.set(g->id);
+    vector<const Cell*> order;
+    while (order.size() < level->num_goals) {
+        const Cell* next = nullptr;
+        for (int i = level->num_goals - 1; i >= 0; i--) {
+            const Cell* g = level->goals_in_packing_order[i];
+            if (!filled[g->id]) continue;
+            filled.reset(g->id);
+            for (auto [d, a] : best->moves)
+                if (!a->goal_room && can_pack_box(a, best, g, filled)) next = g;
+            if (next) break;
+            filled.set(g->id);
+        }
+        if (!next) {
+            for (Cell* c : best_room) c->goal_room = false;
+            return;
+        }
+        order.push_back(next);
+    }
+    level->goal_room_entrance = best;
+    level->goal_room_order.assign(order.rbegin(), order.rend());
+}
+
+// For every alive cell and every subset of boxes on alive cells around it.
+void ComputeSimpleDeadlocks(Level* level) {
+    DynamicBoxes boxes;
+    for (const Cell* a : level->alive())
+        for (uint mask = 0; mask < 256; mask++) {
+            boxes.reset();
+            boxes.set(a->id);
+            bool valid = true;
+            for (int i = 0; i < 8; i++) {
+                if (!(mask & (1u << i))) continue;
+                const int e = level->tables.window(a->id, i);
+                if (e == LevelTables::None) {
+                    valid = false;
+                    break;
+                }
+                boxes.set(e);
+            }
+            if (valid && (is_2x2_deadlock(a, boxes) || is_2x3_deadlock(a, boxes))) level->tables.set_simple_deadlock(a->id, mask);
+        }
+}
+
 const Level* LoadLevel(string_view filename) {
     LevelEnv env;
     env.Load(filename);
     return LoadLevel(env);
 }
 
+const Level* ParseLevel(const vector<string_view>& lines) {
+    LevelEnv env;
+    env.Parse(lines);
+    return LoadLevel(env);
+}
+
 const Level* LoadLevel(const LevelEnv& env, bool extra) {
     Minimal m;
     m.init(env);
@@ -406,7 +520,7 @@ const Level* LoadLevel(const LevelEnv& env, bool extra) {
         m.remove_deadends();
         m.cleanup_walls();
     }
-    int num_dead = m.find_dead_cells();
+    m.find_dead_cells();
 
     // TODO destroy on exception
     Level* level = new Level;
@@ -421,7 +535,9 @@ const Level* LoadLevel(const LevelEnv& env, bool extra) {
     level->num_goals = m.num_goals();
 
     if (m.box[m.agent]) THROW(runtime_error, "agent on box2");
-    level->num_alive = m.cell_count - num_dead;
+    // m.cell_count is only set by cleanup_walls() (if extra)
+    level->num_alive = std::count_if(level->cells.begin(), level->cells.end(), [](const Cell* c) { return c->alive; });
+    level->bitboard = Bitboard(level->cells, level->num_alive, level->buffer.size());
     level->start_agent = GetCell(level, m.agent)->id;
 
     for (Cell* c : level->cells)
@@ -433,7 +549,11 @@ const Level* LoadLevel(const LevelEnv& env, bool extra) {
     if (extra) {
         ComputePushDistances(level);
         ComputeGoalPenalties(level);
+        ComputeTunnels(level);
+        ComputeGoalRoom(level);
     }
+    level->tables = LevelTables(level->cells, level->num_alive, level->num_goals);
+    ComputeSimpleDeadlocks(level);
 
     return level;
 }
@@ -4,4 +4,5 @@
 struct LevelEnv;
 const Level* LoadLevel(const LevelEnv& level_env, bool extra = true);
 const Level* LoadLevel(string_view filename);
+const Level* ParseLevel(const vector<string_view>& lines);  // see LevelEnv::Parse
 void Destroy(const Level*);
@@ -0,0 +1,120 @@
+#pragma once
+#include "core/exception.h"
+#include "sokoban/cell.h"
+#include "sokoban/common.h"
+
+// Read-only copy of the Cell graph as flat arrays indexed by cell id, for hot loops. Non-hot code keeps using Cell*.
+//
+// Moves and pushes are in CSR form: moves of cell A are move_cell[move_begin[A] .. move_begin[A + 1]), and the same
+// for pushes of box from cell A (box destination and agent source, as in Cell::pushes). Push distances are one
+// [goal][alive cell] matrix, so that scans over cells for a goal are contiguous (and vectorize).
+//
+// Simple deadlocks only depend on boxes in 3x3 window around pushed box, so every alive cell has a 256 bit table,
+// indexed by which of its alive neighbors (in Cell::dir8 order) have boxes. It is filled by LoadLevel.
+class LevelTables {
+public:
+    constexpr static short None = -1;
+    constexpr static ushort Inf = numeric_limits<ushort>::max();
+
+    LevelTables() {}
+
+    LevelTables(cspan<Cell*> cells, int num_alive, int num_goals) : _num_alive(num_alive), _num_goals(num_goals) {
+        if (cells.size() > numeric_limits<short>::max()) THROW(runtime_error, "too many cells {}", cells.size());
+        for (int d = 0; d < 4; d++) {
+            _dir[d].resize(cells.size());
+            for (const Cell* c : cells) _dir[d][c->id] = c->dir(d) ? c->dir(d)->id : None;
+        }
+
+        _move_begin.reserve(cells.size() + 1);
+        for (const Cell* c : cells) {
+            _move_begin.push_back(_move_cell.size());
+            for (auto [d, e] : c->moves) {
+                _move_cell.push_back(e->id);
+                _move_dir.push_back(d);
+            }
+        }
+        _move_begin.push_back(_move_cell.size());
+
+        _push_begin.reserve(cells.size() + 1);
+        for (const Cell* c : cells) {
+            _push_begin.push_back(_push_dest.size());
+            for (auto [dest, src] : c->pushes) {
+                _push_dest.push_back(dest->id);
+                _push_src.push_back(src->id);
+            }
+        }
+        _push_begin.push_back(_push_dest.size());
+
+        _windows.resize(num_alive);
+        for (int i = 0; i < num_alive; i++)
+            for (int j = 0; j < 8; j++) {
+                const Cell* e = cells[i]->dir8[j];
+                _windows[i].boxes[j] = (e && e->alive) ? e->id : None;
+            }
+
+        _push_distance.resize(num_goals * num_alive, Inf);
+        for (int i = 0; i < num_alive; i++) {
+            const Cell* c = cells[i];
+            for (int g = 0; g < c->push_distance.size(); g++)
+                if (c->push_distance[g] != Cell::Inf) _push_distance[g * num_alive + i] = std::min<uint>(c->push_distance[g], Inf - 1);
+        }
+    }
+
+    int num_alive() const { return _num_alive; }
+    int num_goals() const { return _num_goals; }
+
+    // Neighbor of cell A in direction d, or None.
+    short dir(int a, int d) const { return _dir[d & 3][a]; }
+
+    int moves_begin(int a) const { return _move_begin[a]; }
+    int moves_end(int a) const { return _move_begin[a + 1]; }
+    short move_cell(int m) const { return _move_cell[m]; }
+    char move_dir(int m) const { return _move_dir[m]; }
+
+    int pushes_begin(int a) const { return _push_begin[a]; }
+    int pushes_end(int a) const { return _push_begin[a + 1]; }
+    short push_dest(int p) const { return _push_dest[p]; }
+    short push_src(int p) const { return _push_src[p]; }
+
+    // Is box on alive cell A a simple deadlock?
+    template <typename Boxes>
+    bool simple_deadlock(int a, const Boxes& boxes) const {
+        const Window& w = _windows[a];
+        uint mask = 0;
+        for (int i = 0; i < 8; i++)
+            if (w.boxes[i] != None && boxes[w.boxes[i]]) mask |= 1u << i;
+        return w.deadlock[mask / 64] & (ulong(1) << (mask % 64));
+    }
+
+    // Alive neighbor of A in Cell::dir8 direction i, or None if it is a wall or dead cell.
+    short window(int a, int i) const { return _windows[a].boxes[i]; }
+
+    void set_simple_deadlock(int a, uint mask) { _windows[a].deadlock[mask / 64] |= ulong(1) << (mask % 64); }
+
+    // Min number of pushes of box from alive cell A to goal G, or Inf.
+    ushort push_distance(int g, int a) const { return _push_distance[g * _num_alive + a]; }
+
+    // out[A] = min(out[A], push_distance(G, A)) for every alive cell A.
+    void minimize_push_distance(int g, ushort* out) const {
+        const ushort* row = _push_distance.data() + g * _num_alive;
+        for (int a = 0; a < _num_alive; a++) out[a] = std::min(out[a], row[a]);
+    }
+
+private:
+    struct Window {
+        array<short, 8> boxes;
+        array<ulong, 4> deadlock = {0, 0, 0, 0};
+    };
+
+    int _num_alive = 0;
+    int _num_goals = 0;
+    array<vector<short>, 4> _dir;
+    vector<uint> _move_begin;
+    vector<short> _move_cell;
+    vector<char> _move_dir;
+    vector<uint> _push_begin;
+    vector<short> _push_dest;
+    vector<short> _push_src;
+    vector<ushort> _push_distance;
+    vector<Window> _windows;  // by alive cell
+};
@@ -0,0 +1,188 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include "sokoban/level.h"
+
+// Board-local deadlock patterns enumerated by 4x5 (see 4x5.cc).
+//
+// Pattern is a small window of walls and boxes, in which boxes can't all be pushed out of the window, even if agent
+// can freely walk around it. It is a deadlock in a real level, if window contains no goals (so all its boxes must
+// leave it), and agent can reach window from its border (as agent in 4x5 always starts outside).
+//
+// Windows are ternary encoded (0 empty, 1 box, 2 wall) like Encode<transform> in 4x5.cc, and all 8 symmetries of
+// every pattern are added to the table, so lookup of a window is a single hash probe.
+class LocalPatterns {
+    constexpr static string_view kEmpty = "  ";
+    constexpr static string_view kBox = "🔴";
+    constexpr static string_view kWall = "✴️ ";
+
+    struct Table {
+        flat_hash_set<ulong> codes;      // key(rows, cols, code)
+        vector<pair<int, int>> shapes;  // (rows, cols)
+    };
+
+    // Window of one of table shapes, at origin (ox, oy).
+    struct Window {
+        short ox, oy;
+        uchar rows, cols;
+    };
+
+public:
+    // Patterns are loaded from all .mt files in patterns_dir (written by 4x5), none if it is empty.
+    LocalPatterns(const Level* level, string_view patterns_dir = "")
+        : _level(level), _width(level->width), _height(level->buffer.size() / level->width), _xy_cell(level->buffer.size(), nullptr) {
+        for (const Cell* c : level->cells) _xy_cell[c->xy] = c;
+        if (!patterns_dir.empty()) _table = load(patterns_dir);
+        init_windows();
+    }
+
+    // Is there a pattern in any window containing pushed_box?
+    template <typename Boxes>
+    bool matches(const int agent, const Boxes& boxes, const Cell* pushed_box) const {
+        for (int i = _windows_begin[pushed_box->id]; i < _windows_begin[pushed_box->id + 1]; i++) {
+            const Window& w = _windows[i];
+            if (!_table.codes.contains(key(w.rows, w.cols, encode(w, boxes)))) continue;
+            if (agent_reaches_border(agent, w.ox, w.oy, w.rows, w.cols, boxes)) return true;
+        }
+        return false;
+    }
+
+    size_t size() const { return _table.codes.size(); }
+
+private:
+    static ulong key(int rows, int cols, ulong code) { return code | (ulong(rows) << 48) | (ulong(cols) << 56); }
+
+    const Cell* cell(int x, int y) const {
+        if (x < 0 || x >= _width || y < 0 || y >= _height) return nullptr;
+        return _xy_cell[x + y * _width];
+    }
+
+    // Goals only depend on level, so windows which contain a goal (can't be a deadlock) are skipped once here.
+    void init_windows() {
+        _windows_begin.resize(_level->num_alive + 1);
+        for (const Cell* a : _level->alive()) {
+            _windows_begin[a->id] = _windows.size();
+            const int x = a->xy % _width;
+            const int y = a->xy / _width;
+            for (auto [rows, cols] : _table.shapes)
+                for (int oy = y - rows + 1; oy <= y; oy++)
+                    for (int ox = x - cols + 1; ox <= x; ox++) {
+                        const Window w{short(ox), short(oy), uchar(rows), uchar(cols)};
+                        if (!contains_goal(w)) _windows.push_back(w);
+                    }
+        }
+        _windows_begin[_level->num_alive] = _windows.size();
+    }
+
+    bool contains_goal(const Window& w) const {
+        for (int r = 0; r < w.rows; r++)
+            for (int c = 0; c < w.cols; c++) {
+                const Cell* e = cell(w.ox + c, w.oy + r);
+                if (e && e->goal) return true;
+            }
+        return false;
+    }
+
+    template <typename Boxes>
+    ulong encode(const Window& w, const Boxes& boxes) const {
+        ulong code = 0;
+        for (int r = 0; r < w.rows; r++)
+            for (int c = 0; c < w.cols; c++) {
+                const Cell* e = cell(w.ox + c, w.oy + r);
+                code = code * 3 + (!e ? 2 : (e->alive && boxes[e->id]) ? 1 : 0);
+            }
+        return code;
+    }
+
+    // Is agent outside of window, or can it walk from its cell to border of window (without leaving it)?
+    template <typename Boxes>
+    bool agent_reaches_border(int agent, int ox, int oy, int rows, int cols, const Boxes& boxes) const {
+        const int xy = _level->cells[agent]->xy;
+        const int x = xy % _width, y = xy / _width;
+        auto inside = [&](int x, int y) { return ox <= x && x < ox + cols && oy <= y && y < oy + rows; };
+        if (!inside(x, y)) return true;
+
+        array<bool, 25> visited;
+        visited.fill(false);
+        static_vector<pair<int, int>, 25> queue;
+        queue.push_back({x, y});
+        visited[(y - oy) * cols + (x - ox)] = true;
+        for (size_t i = 0; i < queue.size(); i++) {
+            auto [ax, ay] = queue[i];
+            if (ax == ox || ay == oy || ax == ox + cols - 1 || ay == oy + rows - 1) return true;
+            for (auto [dx, dy] : {pair{1, 0}, pair{-1, 0}, pair{0, 1}, pair{0, -1}}) {
+                const int bx = ax + dx, by = ay + dy;
+                const Cell* b = cell(bx, by);
+                if (!b || (b->alive && boxes[b->id]) || visited[(by - oy) * cols + (bx - ox)]) continue;
+                visited[(by - oy) * cols + (bx - ox)] = true;
+                queue.push_back({bx, by});
+            }
+        }
+        return false;
+    }
+
+    static Table load(string_view patterns_dir) {
+        Table t;
+        if (!std::filesystem::exists(patterns_dir)) return t;
+        for (const auto& entry : std::filesystem::directory_iterator(patterns_dir)) {
+            if (entry.path().extension() != ".mt") continue;
+            std::ifstream in(entry.path());
+            vector<vector<char>> lines;
+            string line;
+            while (std::getline(in, line)) {
+                if (!line.empty()) {
+                    lines.push_back(parse_line(line));
+                    continue;
+                }
+                if (!lines.empty()) add_symmetries(t, lines);
+                lines.clear();
+            }
+            if (!lines.empty()) add_symmetries(t, lines);
+        }
+        sort(t.shapes);
+        return t;
+    }
+
+    static vector<char> parse_line(string_view line) {
+        vector<char> out;
+        while (!line.empty()) {
+            if (line.starts_with(kEmpty)) { out.push_back(0); line.remove_prefix(kEmpty.size()); continue; }
+            if (line.starts_with(kBox)) { out.push_back(1); line.remove_prefix(kBox.size()); continue; }
+            if (line.starts_with(kWall)) { out.push_back(2); line.remove_prefix(kWall.size()); continue; }
+            THROW(runtime_error, "unexpected cell in pattern: {}", line);
+        }
+        return out;
+    }
+
+    static void add_symmetries(Table& t, const vector<vector<char>>& lines) {
+        const int rows = lines.size();
+        const int cols = lines[0].size();
+        if (rows * cols > 25) THROW(runtime_error, "pattern too large {}x{}", rows, cols);
+        for (const auto& line : lines)
+            if (line.size() != cols) THROW(runtime_error, "uneven pattern");
+
+        for (int transform = 0; transform < 8; transform++) {
+            const bool transpose = transform & 4;
+            const int tr = transpose ? cols : rows;
+            const int tc = transpose ? rows : cols;
+            ulong code = 0;
+            for (int r = 0; r < tr; r++)
+                for (int c = 0; c < tc; c++) {
+                    int mr = transpose ? c : r, mc = transpose ? r : c;
+                    if (transform & 1) mc = cols - 1 - mc;
+                    if (transform & 2) mr = rows - 1 - mr;
+                    code = code * 3 + lines[mr][mc];
+                }
+            t.codes.insert(key(tr, tc, code));
+            if (!contains(t.shapes, pair{tr, tc})) t.shapes.push_back({tr, tc});
+        }
+    }
+
+    const Level* _level;
+    const int _width;
+    const int _height;
+    vector<const Cell*> _xy_cell;
+    Table _table;
+    vector<Window> _windows;     // goal-free windows containing alive cell, by cell id
+    vector<int> _windows_begin;  // by alive cell id, and total at the end
+};
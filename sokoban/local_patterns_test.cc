@@ -0,0 +1,81 @@
+#include "sokoban/level_loader.h"
+#include "sokoban/local_patterns.h"
+#include "sokoban/state.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+// Two patterns in 4x5 file format: 2x2 square of boxes, and 3x3 ring of boxes around empty cell.
+static string WritePatterns() {
+    const auto dir = std::filesystem::temp_directory_path() / "local_patterns_test";
+    std::filesystem::create_directories(dir);
+    std::ofstream out(dir / "test.mt");
+    out << "🔴🔴\n🔴🔴\n\n";
+    out << "🔴🔴🔴\n🔴  🔴\n🔴🔴🔴\n";
+    return dir.string();
+}
+
+// Is there a pattern in any window containing some box of start state?
+static bool MatchesStart(const Level* level, const LocalPatterns& patterns) {
+    for (const Cell* b : level->alive())
+        if (level->start_boxes[b->id] && patterns.matches(level->start_agent, level->start_boxes, b)) return true;
+    return false;
+}
+
+TEST_CASE("LocalPatterns square") {
+    const string dir = WritePatterns();
+    const Level* level = ParseLevel({
+        "##########",
+        "#@       #",
+        "#  $$    #",
+        "#  $$    #",
+        "#     ...#",
+        "#       .#",
+        "##########",
+    });
+    REQUIRE(MatchesStart(level, LocalPatterns(level, dir)));
+    // no patterns without directory
+    REQUIRE(!MatchesStart(level, LocalPatterns(level)));
+    Destroy(level);
+
+    // one of the boxes is on goal, so all boxes don't have to leave the window
+    level = ParseLevel({
+        "##########",
+        "#@       #",
+        "#  $*    #",
+        "#  $$    #",
+        "#      ..#",
+        "#       .#",
+        "##########",
+    });
+    REQUIRE(!MatchesStart(level, LocalPatterns(level, dir)));
+    Destroy(level);
+}
+
+TEST_CASE("LocalPatterns agent inside window") {
+    const string dir = WritePatterns();
+    // agent outside of ring
+    const Level* level = ParseLevel({
+        "###########",
+        "#@        #",
+        "#  $$$ ...#",
+        "#  $ $ ...#",
+        "#  $$$  ..#",
+        "#         #",
+        "###########",
+    });
+    REQUIRE(MatchesStart(level, LocalPatterns(level, dir)));
+    Destroy(level);
+
+    // agent in the middle of ring can't reach window border
+    level = ParseLevel({
+        "###########",
+        "#         #",
+        "#  $$$ ...#",
+        "#  $@$ ...#",
+        "#  $$$  ..#",
+        "#         #",
+        "###########",
+    });
+    REQUIRE(!MatchesStart(level, LocalPatterns(level, dir)));
+    Destroy(level);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "sokoban/level.h"
+
+// Macro pushes move one box several times in one step of search (see SolverOptions::macros). Both are deterministic
+// functions of the parent state, so that solution extraction can expand them back into single pushes.
+
+inline bool in_tunnel(const Cell* c, int d) { return c->tunnel & (1 << (d & 1)); }
+
+// Box pushed from B in direction d, with agent and box in a tunnel, is pushed on while the next cell is in the tunnel
+// too. Nothing can get around the box in the tunnel, so it only makes sense to leave it there on a goal.
+// Returns cell where the box ends (agent is behind it).
+template <typename Boxes>
+const Cell* tunnel_push(const Cell* b, int d, const Boxes& boxes) {
+    const Cell* c = b->dir(d);
+    if (!in_tunnel(b, d)) return c;
+    while (in_tunnel(c, d) && !c->goal) {
+        const Cell* e = c->dir(d);
+        if (!e || !e->alive || boxes[e->id] || !in_tunnel(e, d)) break;
+        c = e;
+    }
+    return c;
+}
+
+// Goal room is clean if its boxes are on a prefix of Level::goal_room_order. Returns next goal to fill in clean room,
+// or null.
+template <typename Boxes>
+const Cell* next_room_goal(const Level* level, const Boxes& boxes) {
+    const Cell* next = nullptr;
+    for (const Cell* g : level->goal_room_order) {
+        if (!boxes[g->id]) {
+            if (!next) next = g;
+        } else if (next) {
+            return nullptr;
+        }
+    }
+    if (!next) return nullptr;
+    for (const Cell* c : level->alive())
+        if (c->goal_room && !c->goal && boxes[c->id]) return nullptr;
+    return next;
+}
+
+// Finds pushes of box from B (agent on A) to goal G, with box staying inside the goal room and other boxes fixed.
+// Appends them as (agent, dir) of each push, unless pushes is null. BFS over (agent, box) pairs, so it is the fewest
+// moves and pushes together (not the fewest pushes).
+template <typename Boxes>
+bool pack_box(const Cell* a, const Cell* b, const Cell* g, const Boxes& boxes, vector<pair<const Cell*, int>>* pushes) {
+    const Level* level = a->level;
+    const int num_alive = level->num_alive;
+    auto index = [&](const Cell* agent, const Cell* box) { return agent->id * num_alive + box->id; };
+
+    // previous pair of every visited pair, by index(agent, box), or -1
+    // reused between calls, visited pairs (all in queue) are reset at the end
+    thread_local vector<int> prev;
+    thread_local vector<pair<const Cell*, const Cell*>> queue;
+    if (prev.size() < level->cells.size() * num_alive) prev.resize(level->cells.size() * num_alive, -1);
+    queue.clear();
+    queue.emplace_back(a, b);
+    prev[index(a, b)] = index(a, b);
+
+    bool found = false;
+    for (int i = 0; i < queue.size(); i++) {
+        auto [agent, box] = queue[i];
+        if (box == g) {
+            if (pushes) {
+                const size_t begin = pushes->size();
+                for (int j = index(agent, box); prev[j] != j; j = prev[j]) {
+                    const Cell* p_box = level->cells[prev[j] % num_alive];
+                    if (p_box == level->cells[j % num_alive]) continue;
+                    const Cell* p_agent = level->cells[prev[j] / num_alive];
+                    for (auto [d, e] : p_agent->moves)
+                        if (e == p_box) pushes->emplace_back(p_agent, d);
+                }
+                std::reverse(pushes->begin() + begin, pushes->end());
+            }
+            found = true;
+            break;
+        }
+        for (auto [d, e] : agent->moves) {
+            const Cell* nbox = box;
+            if (e == box) {
+                nbox = box->dir(d);
+                if (!nbox || !nbox->alive || !nbox->goal_room || boxes[nbox->id]) continue;
+            } else if (e->alive && boxes[e->id]) {
+                continue;
+            }
+            const int j = index(e, nbox);
+            if (prev[j] != -1) continue;
+            prev[j] = index(agent, box);
+            queue.emplace_back(e, nbox);
+        }
+    }
+    for (auto [agent, box] : queue) prev[index(agent, box)] = -1;
+    return found;
+}
+
+template <typename Boxes>
+bool pack_box(const Cell* a, const Cell* b, const Cell* g, const Boxes& boxes, vector<pair<const Cell*, int>>& pushes) {
+    return pack_box(a, b, g, boxes, &pushes);
+}
+
+// Can box be pushed from B (agent on A) to goal G, as by pack_box()?
+template <typename Boxes>
+bool can_pack_box(const Cell* a, const Cell* b, const Cell* g, const Boxes& boxes) {
+    return pack_box(a, b, g, boxes, nullptr);
+}
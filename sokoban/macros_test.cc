@@ -0,0 +1,79 @@
+#include "core/fmt.h"
+#include "sokoban/level_env.h"
+#include "sokoban/level_loader.h"
+#include "sokoban/macros.h"
+#include "sokoban/state.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+static int CountTunnels(const Level* level) {
+    int count = 0;
+    for (const Cell* c : level->alive()) count += c->tunnel ? 1 : 0;
+    return count;
+}
+
+TEST_CASE("tunnel is one-way") {
+    // only way between left and right rooms
+    const Level* level = ParseLevel({
+        "###########",
+        "#   ###   #",
+        "# $      .#",
+        "#@  ###   #",
+        "###########",
+    });
+    REQUIRE(CountTunnels(level) > 0);
+    Destroy(level);
+
+    // same, but agent can walk around
+    level = ParseLevel({
+        "###########",
+        "#         #",
+        "# $ ### ..#",
+        "#@$     $ #",
+        "#   ### . #",
+        "###########",
+    });
+    REQUIRE(CountTunnels(level) == 0);
+    Destroy(level);
+}
+
+// Pushes found by pack_box() must move box from goal room entrance to goal, and be the same when called again (buffers
+// are reused between calls).
+TEST_CASE("pack_box") {
+    long levels = 0, packed = 0;
+    for (const string_view file : {"microban1", "microban2", "original"}) {
+        const int num = NumberOfLevels(format("sokoban/levels/{}", file));
+        for (int i = 1; i <= num; i++) {
+            const Level* level = LoadLevel(format("sokoban/levels/{}:{}", file, i));
+            const Cell* entrance = level->goal_room_entrance;
+            if (!entrance) {
+                Destroy(level);
+                continue;
+            }
+            levels += 1;
+            DynamicBoxes boxes;
+            for (auto [d, a] : entrance->moves) {
+                if (a->goal_room) continue;
+                for (const Cell* g : level->goal_room_order) {
+                    vector<pair<const Cell*, int>> pushes, again;
+                    const bool found = pack_box(a, entrance, g, boxes, pushes);
+                    REQUIRE(pack_box(a, entrance, g, boxes, again) == found);
+                    REQUIRE((pushes == again));
+                    if (!found) continue;
+
+                    const Cell* box = entrance;
+                    for (auto [agent, dir] : pushes) {
+                        REQUIRE(agent->dir(dir) == box);
+                        box = box->dir(dir);
+                        REQUIRE(box->goal_room);
+                    }
+                    REQUIRE(box == g);
+                    packed += 1;
+                }
+            }
+            Destroy(level);
+        }
+    }
+    REQUIRE(levels > 0);
+    REQUIRE(packed > 0);
+}
@@ -125,12 +125,25 @@ int main(int argc, char** argv) {
         ("alt", po::bool_switch(&options.alt), "")
         ("animate", po::bool_switch(&options.animate), "")
         ("single-thread", po::bool_switch(&options.single_thread), "")
+        ("threads", po::value<int>(&options.threads), "")
         ("unsolved", po::bool_switch(&options.unsolved), "")
         ("verbosity", po::value<int>(&options.verbosity), "")
         ("dist_w", po::value<int>(&options.dist_w), "")
         ("heur_w", po::value<int>(&options.heur_w), "")
+        ("matching_heuristic", po::value<bool>(&options.matching_heuristic), "")
         ("must_solve", po::value<bool>(&options.must_solve), "")
         ("monitor", po::value<bool>(&options.monitor), "")
+        ("persistent_deadlocks", po::value<bool>(&options.persistent_deadlocks), "")
+        ("local_patterns", po::value<string>(&options.local_patterns), "")
+        ("compact_states", po::value<bool>(&options.compact_states), "")
+        ("verify_states", po::value<bool>(&options.verify_states), "")
+        ("queue_memory_mb", po::value<int>(&options.queue_memory_mb), "")
+        ("checkpoint_period", po::value<int>(&options.checkpoint_period), "")
+        ("resume", po::bool_switch(&options.resume), "")
+        ("backward_threads", po::value<int>(&options.backward_threads), "")
+        ("tunnel_macros", po::value<bool>(&options.tunnel_macros), "")
+        ("goal_room_macros", po::value<bool>(&options.goal_room_macros), "")
+        ("pattern_db", po::value<bool>(&options.pattern_db), "")
         ("deadlocks", po::value<string>(), "")
         ("scan", po::value<string>(), "")
         ("open", po::value<string>(), "")
@@ -0,0 +1,72 @@
+#include "core/fmt.h"
+#include "sokoban/level_env.h"
+#include "sokoban/level_loader.h"
+#include "sokoban/random_walk.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+// Agent from normalize_push() (incremental or not) must be the same as from full normalize(), for every push along
+// random walks.
+TEST_CASE("normalize_push") {
+    std::mt19937 random(0);
+    long pushes = 0, incremental = 0;
+    const int num = NumberOfLevels("sokoban/levels/microban1");
+    for (int i = 1; i <= num; i++) {
+        const Level* level = LoadLevel(format("sokoban/levels/microban1:{}", i));
+        RandomWalks(level, 20, 50, random, [&](const DynamicState& s) {
+            Bitboard::Bits reachable;
+            for_each_push(level, s, reachable, [&](const Cell* a, const Cell* b, int d) {
+                DynamicState ns(b->id, s.boxes);
+                ns.boxes.move(b, b->dir(d));
+                Agent full = ns.agent;
+                normalize(level, &full, ns.boxes);
+                if (normalize_push(level, reachable, b, b->dir(d), ns.boxes, &ns.agent)) incremental += 1;
+                REQUIRE(ns.agent == full);
+                pushes += 1;
+            });
+        });
+        Destroy(level);
+    }
+    REQUIRE(pushes > 0);
+    REQUIRE(incremental > 0);
+    REQUIRE(incremental < pushes);
+}
+
+// Level buffer larger than inline capacity of Bitboard::Bits (4096 cells): rooms in opposite corners, connected by
+// a long corridor.
+TEST_CASE("normalize large level") {
+    constexpr int W = 90, H = 50;
+    vector<string> rows(H, string(W, '#'));
+    for (int x = 1; x <= 6; x++)
+        for (int y = 1; y <= 3; y++) rows[y][x] = ' ';
+    for (int y = 4; y < H - 3; y++) rows[y][3] = ' ';
+    for (int x = 3; x < W - 10; x++) rows[H - 3][x] = ' ';
+    for (int x = W - 10; x < W - 1; x++)
+        for (int y = H - 5; y < H - 1; y++) rows[y][x] = ' ';
+    rows[1][1] = '@';
+    rows[H - 4][W - 6] = '$';
+    rows[H - 3][W - 4] = '$';
+    rows[H - 4][W - 3] = '.';
+    rows[H - 2][W - 3] = '.';
+    const Level* level = ParseLevel(vector<string_view>(rows.begin(), rows.end()));
+    REQUIRE(level->bitboard.words() > Bitboard::InlineWords);
+
+    std::mt19937 random(0);
+    long pushes = 0;
+    RandomWalks(level, 20, 30, random, [&](const DynamicState& s) {
+        Bitboard::Bits reachable;
+        for_each_push(level, s, reachable, [&](const Cell* a, const Cell* b, int d) {
+            DynamicState ns(b->id, s.boxes);
+            ns.boxes.move(b, b->dir(d));
+            Agent full = ns.agent;
+            normalize(level, &full, ns.boxes);
+            normalize_push(level, reachable, b, b->dir(d), ns.boxes, &ns.agent);
+            REQUIRE(ns.agent == full);
+            pushes += 1;
+        });
+        // agent is normalized to the first cell of the level, which is in the top left room
+        REQUIRE(level->cells[s.agent]->xy < level->width * 5);
+    });
+    REQUIRE(pushes > 0);
+    Destroy(level);
+}
@@ -0,0 +1,229 @@
+#pragma once
+#include "core/bits_util.h"
+#include "core/exception.h"
+#include "core/fmt.h"
+#include "core/thread.h"
+#include "core/timestamp.h"
+#include "sokoban/level.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <filesystem>
+#include <fstream>
+
+// Min number of pushes to put two boxes on goals, with no other boxes and agent anywhere, for every pair of alive
+// cells. Every push moves one box, so sum of pair costs over disjoint pairs of boxes is a lower bound of pushes, and
+// bonus() is how much more than single box distances it is for the best such pairing.
+//
+// Table is computed by retrograde BFS (pulls from all pairs of goals, layer by layer in parallel) once per level, and
+// saved in /tmp/sokoban/pattern_db. Later runs memory map it.
+class PatternDB {
+public:
+    constexpr static ushort Inf = numeric_limits<ushort>::max();
+    constexpr static long MaxStates = long(1) << 27;  // (agent, pair) states of BFS
+
+    PatternDB(const Level* level, bool persistent, int threads, int verbosity = 0) : _level(level) {
+        if (level->num_goals < 2) return;
+        if (long(level->cells.size()) * num_pairs() > MaxStates) {
+            if (verbosity > 0) print(warning, "Warning: level is too large for pattern database\n");
+            return;
+        }
+
+        const string filename = format("{}/{:016x}.bin", kPatternDBPath, level->hash());
+        if (persistent && std::filesystem::exists(filename) && std::filesystem::file_size(filename) == num_pairs() * sizeof(ushort)) {
+            namespace bi = boost::interprocess;
+            bi::file_mapping file(filename.data(), bi::read_only);
+            _region = bi::mapped_region(file, bi::read_only);
+            _cost = reinterpret_cast<const ushort*>(_region.get_address());
+            return;
+        }
+
+        Timestamp ts;
+        _table = build(threads);
+        _cost = _table.data();
+        if (verbosity > 0) print("pattern database ({} pairs) in {:.3f}s\n", num_pairs(), ts.elapsed_s());
+        if (!persistent) return;
+
+        std::filesystem::create_directories(kPatternDBPath);
+        const string tmp_filename = filename + ".tmp";
+        std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(_table.data()), _table.size() * sizeof(ushort));
+        out.close();
+        if (!out) THROW(runtime_error, "failed to write {}", tmp_filename);
+        std::filesystem::rename(tmp_filename, filename);
+    }
+
+    bool empty() const { return !_cost; }
+
+    // Pushes to put boxes on alive cells A and B (A != B) on goals, or Inf if they can't both get there.
+    ushort cost(int a, int b) const { return _cost[index(a, b)]; }
+
+    // Max sum of cost(A, B) - dist(A) - dist(B) over disjoint pairs of boxes, where dist(box) is its own lower bound
+    // in heuristic(). Exact if at most MaxExactBoxes boxes have a pair with positive gain, otherwise pairs are picked
+    // greedily by largest gain. Cell::Inf if any pair of boxes can't be solved.
+    template <typename Boxes, typename DistFn>
+    uint bonus(const Boxes& boxes, const DistFn& dist) const {
+        thread_local vector<const Cell*> box;
+        thread_local vector<std::tuple<uint, int, int>> gains;
+        box.clear();
+        gains.clear();
+        for (const Cell* c : _level->alive())
+            if (boxes[c->id]) box.push_back(c);
+
+        for (int j = 0; j < box.size(); j++)
+            for (int i = 0; i < j; i++) {
+                const ushort c = cost(box[i]->id, box[j]->id);
+                if (c == Inf) return Cell::Inf;
+                const uint single = dist(box[i]) + dist(box[j]);
+                if (c > single) gains.emplace_back(c - single, i, j);
+            }
+        if (gains.empty()) return 0;
+
+        // renumber boxes with any gain
+        thread_local vector<int> vertex;
+        vertex.assign(box.size(), -1);
+        int num_vertices = 0;
+        for (auto [gain, i, j] : gains) {
+            if (vertex[i] == -1) vertex[i] = num_vertices++;
+            if (vertex[j] == -1) vertex[j] = num_vertices++;
+        }
+        if (num_vertices <= MaxExactBoxes) return max_pairing(gains, vertex, num_vertices);
+
+        std::sort(gains.begin(), gains.end(), [](const auto& a, const auto& b) { return std::get<0>(a) > std::get<0>(b); });
+        uint total = 0;
+        thread_local vector<bool> used;
+        used.assign(box.size(), false);
+        for (auto [gain, i, j] : gains)
+            if (!used[i] && !used[j]) {
+                used[i] = used[j] = true;
+                total += gain;
+            }
+        return total;
+    }
+
+private:
+    constexpr static string_view kPatternDBPath = "/tmp/sokoban/pattern_db";
+    constexpr static int Chunk = 1024;
+    constexpr static int MaxExactBoxes = 8;
+
+    // Max weight pairing for bonus(), by DP over subsets of vertices (in order of their lowest vertex).
+    static uint max_pairing(const vector<std::tuple<uint, int, int>>& gains, const vector<int>& vertex, int num_vertices) {
+        thread_local array<uint, MaxExactBoxes * MaxExactBoxes> weight;
+        thread_local array<uint, 1 << MaxExactBoxes> best;
+        std::fill(weight.begin(), weight.begin() + num_vertices * MaxExactBoxes, 0);
+        for (auto [gain, i, j] : gains) {
+            weight[vertex[i] * MaxExactBoxes + vertex[j]] = gain;
+            weight[vertex[j] * MaxExactBoxes + vertex[i]] = gain;
+        }
+
+        best[0] = 0;
+        for (uint mask = 1; mask < (1u << num_vertices); mask++) {
+            // lowest vertex in mask is either unpaired, or paired with another vertex in mask
+            const int v = ctz(mask);
+            const uint rest = mask & (mask - 1);
+            uint b = best[rest];
+            for (uint m = rest; m; m &= m - 1) {
+                const int u = ctz(m);
+                const uint w = weight[v * MaxExactBoxes + u];
+                if (w) b = std::max(b, w + best[rest & ~(1u << u)]);
+            }
+            best[mask] = b;
+        }
+        return best[(1u << num_vertices) - 1];
+    }
+
+    // Agent is normalized, and X < Y.
+    struct Node {
+        short agent, x, y;
+    };
+
+    static long index(int a, int b) {
+        if (a > b) std::swap(a, b);
+        return long(b) * (b - 1) / 2 + a;
+    }
+
+    long num_pairs() const { return long(_level->num_alive) * (_level->num_alive - 1) / 2; }
+
+    void box_bits(const Node& n, Bitboard::Bits& bits) const {
+        _level->bitboard.clear(bits);
+        Bitboard::set(bits, _level->cells[n.x]->xy);
+        Bitboard::set(bits, _level->cells[n.y]->xy);
+    }
+
+    // Adds all pulls from N which are not visited yet to out.
+    template <typename VisitFn>
+    void expand(const Node& n, const VisitFn& visit, vector<Node>& out) const {
+        const Bitboard& bitboard = _level->bitboard;
+        Bitboard::Bits bits, reachable, next_reachable;
+        box_bits(n, bits);
+        bitboard.fill(_level->cells[n.agent]->xy, bits, reachable);
+
+        for (int k = 0; k < 2; k++) {
+            const Cell* b = _level->cells[k == 0 ? n.x : n.y];
+            const int other = k == 0 ? n.y : n.x;
+            for (int d = 0; d < 4; d++) {
+                // agent on A pulls box from B to A, and steps back to C
+                const Cell* a = b->dir(d ^ 2);
+                if (!a || !a->alive || !Bitboard::test(reachable, a->xy)) continue;
+                const Cell* c = a->dir(d ^ 2);
+                if (!c || !Bitboard::test(reachable, c->xy)) continue;
+
+                Node m{0, short(std::min(a->id, other)), short(std::max(a->id, other))};
+                box_bits(m, bits);
+                bitboard.fill(c->xy, bits, next_reachable);
+                m.agent = bitboard.lowest(next_reachable)->id;
+                if (visit(m)) out.push_back(m);
+            }
+        }
+    }
+
+    vector<ushort> build(int threads) const {
+        const Level* level = _level;
+        const long pairs = num_pairs();
+        vector<ushort> cost(pairs, Inf);
+        vector<atomic<ulong>> visited((level->cells.size() * pairs + 63) / 64);
+        auto visit = [&](const Node& n) {
+            const long i = n.agent * pairs + index(n.x, n.y);
+            const ulong bit = ulong(1) << (i % 64);
+            return !(visited[i / 64].fetch_or(bit) & bit);
+        };
+
+        // all pairs of goals, with agent in each of their regions
+        vector<Node> frontier;
+        Bitboard::Bits bits, reachable, covered;
+        for (const Cell* g2 : level->goals())
+            for (const Cell* g1 : level->goals()) {
+                if (g1->id >= g2->id) continue;
+                Node n{0, short(g1->id), short(g2->id)};
+                box_bits(n, bits);
+                level->bitboard.clear(covered);
+                for (const Cell* a : level->cells) {
+                    if (a == g1 || a == g2 || Bitboard::test(covered, a->xy)) continue;
+                    level->bitboard.fill(a->xy, bits, reachable);
+                    for (int i = 0; i < level->bitboard.words(); i++) covered[i] |= reachable[i];
+                    n.agent = level->bitboard.lowest(reachable)->id;
+                    if (visit(n)) frontier.push_back(n);
+                }
+            }
+
+        for (ushort layer = 0; !frontier.empty() && layer < Inf - 1; layer++) {
+            for (const Node& n : frontier) {
+                ushort& c = cost[index(n.x, n.y)];
+                if (c == Inf) c = layer;
+            }
+            vector<vector<Node>> next((frontier.size() + Chunk - 1) / Chunk);
+            parallel_for(next.size(), threads, [&](size_t i) {
+                const size_t end = std::min(frontier.size(), (i + 1) * Chunk);
+                for (size_t j = i * Chunk; j < end; j++) expand(frontier[j], visit, next[i]);
+            });
+            frontier.clear();
+            for (const vector<Node>& v : next) frontier.insert(frontier.end(), v.begin(), v.end());
+        }
+        return cost;
+    }
+
+    const Level* _level;
+    const ushort* _cost = nullptr;  // by index(A, B), either in _table or in _region
+    vector<ushort> _table;
+    boost::interprocess::mapped_region _region;
+};
@@ -0,0 +1,180 @@
+#include "core/fmt.h"
+#include "sokoban/level_env.h"
+#include "sokoban/level_loader.h"
+#include "sokoban/pattern_db.h"
+#include "sokoban/state.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <deque>
+#include <random>
+
+// Min pushes to put boxes from A and B on goals, with agent starting anywhere. Forward 0-1 BFS over (agent, box, box),
+// independent of PatternDB::build() (which pulls from goals).
+static ushort PairCost(const Level* level, const Cell* a, const Cell* b) {
+    const long n = level->cells.size();
+    auto index = [&](const Cell* agent, const Cell* x, const Cell* y) { return (agent->id * n + x->id) * n + y->id; };
+    vector<ushort> dist(n * n * n, PatternDB::Inf);
+    std::deque<std::tuple<const Cell*, const Cell*, const Cell*>> queue;
+    for (const Cell* c : level->cells)
+        if (c != a && c != b) {
+            dist[index(c, a, b)] = 0;
+            queue.emplace_back(c, a, b);
+        }
+    while (!queue.empty()) {
+        auto [agent, x, y] = queue.front();
+        queue.pop_front();
+        const ushort d = dist[index(agent, x, y)];
+        if (x->goal && y->goal) return d;
+        for (auto [dir, e] : agent->moves) {
+            if (e == x || e == y) {
+                const Cell* other = (e == x) ? y : x;
+                const Cell* f = e->dir(dir);
+                if (!f || !f->alive || f == other) continue;
+                ushort& nd = dist[index(e, f, other)];
+                if (d + 1 < nd) {
+                    nd = d + 1;
+                    queue.emplace_back(e, f, other);
+                }
+            } else {
+                ushort& nd = dist[index(e, x, y)];
+                if (d < nd) {
+                    nd = d;
+                    queue.emplace_front(e, x, y);
+                }
+            }
+        }
+    }
+    return PatternDB::Inf;
+}
+
+// Max sum of gains over disjoint pairs of boxes, by trying all pairings.
+static uint BruteForcePairing(const vector<const Cell*>& box, vector<bool>& used, const PatternDB& db) {
+    int i = 0;
+    while (i < box.size() && used[i]) i++;
+    if (i == box.size()) return 0;
+    used[i] = true;
+    uint best = BruteForcePairing(box, used, db);
+    for (int j = i + 1; j < box.size(); j++) {
+        if (used[j]) continue;
+        const uint cost = db.cost(box[i]->id, box[j]->id);
+        const uint single = box[i]->min_push_distance + box[j]->min_push_distance;
+        if (cost <= single) continue;
+        used[j] = true;
+        best = std::max(best, cost - single + BruteForcePairing(box, used, db));
+        used[j] = false;
+    }
+    used[i] = false;
+    return best;
+}
+
+// Pair costs are exact, zero only on goals, and often more than push distances of both boxes alone.
+TEST_CASE("PatternDB") {
+    std::mt19937 random(0);
+    const int num = NumberOfLevels("sokoban/levels/microban1");
+    long pairs = 0, interactions = 0, checked = 0, unsolvable = 0;
+    for (int i = 1; i <= num; i++) {
+        const Level* level = LoadLevel(format("sokoban/levels/microban1:{}", i));
+        PatternDB db(level, false, 4);
+        if (db.empty()) {
+            Destroy(level);
+            continue;
+        }
+        for (const Cell* b : level->alive())
+            for (const Cell* a : level->alive()) {
+                if (a->id >= b->id) continue;
+                pairs += 1;
+                const ushort cost = db.cost(a->id, b->id);
+                REQUIRE((cost == 0) == (a->goal && b->goal));
+                if (cost != PatternDB::Inf && cost > a->min_push_distance + b->min_push_distance) interactions += 1;
+                if (i <= 20 && random() % 8 == 0) {
+                    REQUIRE(cost == PairCost(level, a, b));
+                    checked += 1;
+                    unsolvable += (cost == PatternDB::Inf) ? 1 : 0;
+                }
+            }
+        Destroy(level);
+    }
+    REQUIRE(pairs > 0);
+    REQUIRE(interactions > 0);
+    REQUIRE(checked > 100);
+    REQUIRE(unsolvable > 0);
+}
+
+// Boxes can only move along the top row, left to the goals:
+//   ########
+//   #..$$  #
+//   #   @  #
+//   ########
+// Box on column X needs X - 1 pushes to the first goal, and X - 2 to the second one. Boxes next to each other can't
+// be pushed at all.
+TEST_CASE("PatternDB row") {
+    const Level* level = ParseLevel({"########", "#..$$  #", "#   @  #", "########"});
+    PatternDB db(level, false, 1);
+    REQUIRE(!db.empty());
+
+    // by column - 1
+    vector<const Cell*> row(level->alive().begin(), level->alive().end());
+    std::sort(row.begin(), row.end(), [](const Cell* a, const Cell* b) { return a->xy < b->xy; });
+    REQUIRE(row.size() == 5);
+    auto cost = [&](int x1, int x2) { return db.cost(row[x1 - 1]->id, row[x2 - 1]->id); };
+    REQUIRE(cost(1, 2) == 0);
+    REQUIRE(cost(1, 3) == 1);
+    REQUIRE(cost(2, 4) == 3);
+    REQUIRE(cost(3, 5) == 5);
+    REQUIRE(cost(1, 5) == 3);
+    REQUIRE(cost(2, 3) == PatternDB::Inf);
+    REQUIRE(cost(3, 4) == PatternDB::Inf);
+    REQUIRE(cost(4, 5) == PatternDB::Inf);
+    for (const Cell* b : level->alive())
+        for (const Cell* a : level->alive())
+            if (a->id < b->id) REQUIRE(db.cost(a->id, b->id) == PairCost(level, a, b));
+    Destroy(level);
+}
+
+// bonus() is the best pairing when at most 8 boxes have gains, and never more than that otherwise.
+TEST_CASE("PatternDB bonus") {
+    std::mt19937 random(0);
+    long exact = 0, positive = 0;
+    for (const string_view file : {"microban1", "microban2"}) {
+        const int num = NumberOfLevels(format("sokoban/levels/{}", file));
+        for (int i = 1; i <= num; i++) {
+            const Level* level = LoadLevel(format("sokoban/levels/{}:{}", file, i));
+            PatternDB db(level, false, 4);
+            if (db.empty()) {
+                Destroy(level);
+                continue;
+            }
+            for (int k = 0; k < 20; k++) {
+                DynamicBoxes boxes;
+                vector<const Cell*> box;
+                for (const Cell* c : level->alive())
+                    if (box.size() < level->num_goals && random() % 3 == 0) {
+                        boxes.set(c->id);
+                        box.push_back(c);
+                    }
+                bool solvable = true;
+                for (int a = 0; a < box.size(); a++)
+                    for (int b = 0; b < a; b++) solvable &= db.cost(box[a]->id, box[b]->id) != PatternDB::Inf;
+
+                const uint bonus = db.bonus(boxes, [](const Cell* c) { return c->min_push_distance; });
+                if (!solvable) {
+                    REQUIRE(bonus == Cell::Inf);
+                    continue;
+                }
+                if (box.size() > 10) continue;
+                vector<bool> used(box.size(), false);
+                const uint best = BruteForcePairing(box, used, db);
+                REQUIRE(bonus <= best);
+                if (box.size() <= 8) {
+                    REQUIRE(bonus == best);
+                    exact += 1;
+                }
+                positive += (bonus > 0) ? 1 : 0;
+            }
+            Destroy(level);
+        }
+    }
+    REQUIRE(exact > 100);
+    REQUIRE(positive > 0);
+}
@@ -0,0 +1,69 @@
+#include "core/fmt.h"
+#include "core/string.h"
+#include "core/timestamp.h"
+
+#include "sokoban/deadlock.h"
+#include "sokoban/level_loader.h"
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+constexpr string_view kPrefix = "sokoban/levels/";
+
+// Deadlock pattern matching throughput (patterns tested per second) for different number of patterns.
+// Example: bazel run -c opt //sokoban:patterns_benchmark -- --level microban4:75 --patterns 100 10000 100000
+int main(int argc, char** argv) {
+    string level_name = "original:1";
+    vector<int> patterns = {100, 10000, 100000};
+    long tests = 200'000'000;
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("level", po::value<string>(&level_name), "")
+        ("patterns", po::value<vector<int>>(&patterns)->multitoken(), "")
+        ("tests", po::value<long>(&tests), "")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    const Level* level = LoadLevel(cat(kPrefix, level_name));
+    std::mt19937_64 random(0);
+    auto uniform = [&](int n) { return int(random() % n); };
+
+    // Every pattern has a box on marker cell, and queries never do, so each query tests all patterns.
+    const int marker = level->num_alive - 1;
+
+    print("{}: {} cells, {} alive\n", level_name, level->cells.size(), level->num_alive);
+    print("patterns    queries    seconds   patterns/s\n");
+    for (int n : patterns) {
+        Patterns db(level);
+        for (int i = 0; i < n; i++) {
+            DynamicBoxes boxes;
+            boxes.set(marker);
+            for (int j = 1 + uniform(4); j > 0; j--) boxes.set(uniform(level->num_alive));
+            db.add(uniform(level->cells.size()), boxes);
+        }
+
+        vector<pair<int, DynamicBoxes>> queries(1000);
+        for (auto& [agent, boxes] : queries) {
+            agent = uniform(level->cells.size());
+            for (int j = 0; j < level->num_goals; j++) boxes.set(uniform(marker));
+        }
+
+        const long num_queries = std::max<long>(1, tests / n);
+        int matches = 0;
+        Timestamp start_ts;
+        for (long i = 0; i < num_queries; i++) {
+            const auto& [agent, boxes] = queries[i % queries.size()];
+            if (db.matches(agent, boxes)) matches += 1;
+        }
+        const double elapsed_s = start_ts.elapsed_s();
+        if (matches > 0) THROW(runtime_error, "unexpected matches {}", matches);
+        print("{:8} {:10} {:10.3f} {:12.0f}\n", n, num_queries, elapsed_s, num_queries * n / elapsed_s);
+    }
+
+    Destroy(level);
+    return 0;
+}
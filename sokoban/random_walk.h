@@ -0,0 +1,27 @@
+#pragma once
+#include "sokoban/level.h"
+#include "sokoban/state.h"
+#include "sokoban/util.h"
+
+#include <random>
+
+// For tests. Calls visit(s) for every state along random walks from start state of level, with up to max_steps
+// random pushes in each walk. Agent of every state is normalized.
+template <typename Visit>
+void RandomWalks(const Level* level, int walks, int max_steps, std::mt19937& random, const Visit& visit) {
+    vector<pair<const Cell*, int>> pushes;
+    for (int walk = 0; walk < walks; walk++) {
+        DynamicState s(level->start_agent, level->start_boxes);
+        normalize(level, &s.agent, s.boxes);
+        for (int step = 0; step < max_steps; step++) {
+            visit(s);
+            pushes.clear();
+            for_each_push(level, s, [&](const Cell* a, const Cell* b, int d) { pushes.emplace_back(b, d); });
+            if (pushes.empty()) break;
+            auto [b, d] = pushes[random() % pushes.size()];
+            s.boxes.move(b, b->dir(d));
+            s.agent = b->id;
+            normalize(level, &s.agent, s.boxes);
+        }
+    }
+}
@@ -0,0 +1,145 @@
+#include "core/fmt.h"
+#include "sokoban/level_env.h"
+#include "sokoban/level_loader.h"
+#include "sokoban/util.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <filesystem>
+#include <random>
+
+static bool is_2x2_or_2x3_deadlock(const Cell* a, const DynamicBoxes& boxes) {
+    return is_2x2_deadlock(a, boxes) || is_2x3_deadlock(a, boxes);
+}
+
+static const Cell* BoxAt(const Level* level, int index) {
+    int i = 0;
+    for (const Cell* a : level->alive())
+        if (level->start_boxes[a->id] && i++ == index) return a;
+    return nullptr;
+}
+
+// Table lookup in is_simple_deadlock() must agree with is_2x2_deadlock() || is_2x3_deadlock() for every box
+// configuration around every alive cell of every level.
+TEST_CASE("is_simple_deadlock") {
+    long levels = 0, mismatches = 0;
+    for (const auto& entry : std::filesystem::directory_iterator("sokoban/levels")) {
+        const string filename = entry.path().string();
+        const int num = NumberOfLevels(filename);
+        for (int i = 1; i <= num; i++) {
+            LevelEnv env;
+            env.Load(format("{}:{}", filename, i));
+            if (!env.IsValid()) continue;
+            const Level* level = LoadLevel(env);
+            levels += 1;
+
+            DynamicBoxes boxes;
+            for (const Cell* a : level->alive())
+                for (uint mask = 0; mask < 256; mask++) {
+                    boxes.reset();
+                    boxes.set(a->id);
+                    for (int j = 0; j < 8; j++) {
+                        const Cell* e = a->dir8[j];
+                        if ((mask & (1u << j)) && e && e->alive) boxes.set(e->id);
+                    }
+                    if (is_simple_deadlock(a, boxes) != is_2x2_or_2x3_deadlock(a, boxes)) mismatches += 1;
+                }
+            Destroy(level);
+        }
+    }
+    REQUIRE(levels > 4000);
+    REQUIRE(mismatches == 0);
+}
+
+// Boxes outside of 3x3 window around pushed box can't change the result.
+TEST_CASE("is_simple_deadlock outside window") {
+    std::mt19937 random(0);
+    long deadlocks = 0, checks = 0;
+    const int num = NumberOfLevels("sokoban/levels/original");
+    for (int i = 1; i <= num; i++) {
+        const Level* level = LoadLevel(format("sokoban/levels/original:{}", i));
+        DynamicBoxes boxes;
+        for (const Cell* a : level->alive())
+            for (int k = 0; k < 20; k++) {
+                boxes.reset();
+                boxes.set(a->id);
+                for (const Cell* e : a->dir8)
+                    if (e && e->alive && random() % 2) boxes.set(e->id);
+                const bool expected = is_2x2_or_2x3_deadlock(a, boxes);
+                for (const Cell* b : level->alive()) {
+                    bool near = b == a;
+                    for (const Cell* e : a->dir8) near |= b == e;
+                    if (!near && random() % 3 == 0) boxes.set(b->id);
+                }
+                REQUIRE(is_simple_deadlock(a, boxes) == expected);
+                REQUIRE(is_2x2_or_2x3_deadlock(a, boxes) == expected);
+                deadlocks += expected ? 1 : 0;
+                checks += 1;
+            }
+        Destroy(level);
+    }
+    REQUIRE(deadlocks > 0);
+    REQUIRE(deadlocks < checks);
+}
+
+TEST_CASE("is_simple_deadlock 2x3") {
+    // #$
+    // $#
+    const Level* level = ParseLevel({
+        "########",
+        "#      #",
+        "# #$   #",
+        "#  $#  #",
+        "#@   ..#",
+        "########",
+    });
+    for (int i = 0; i < 2; i++) {
+        const Cell* box = BoxAt(level, i);
+        REQUIRE(box);
+        REQUIRE(is_simple_deadlock(box, level->start_boxes));
+        REQUIRE(is_2x3_deadlock(box, level->start_boxes));
+        REQUIRE(!is_2x2_deadlock(box, level->start_boxes));
+
+        DynamicBoxes alone;
+        alone.set(box->id);
+        REQUIRE(!is_simple_deadlock(box, alone));
+    }
+    Destroy(level);
+
+    // same, but both boxes on goals
+    level = ParseLevel({
+        "########",
+        "#      #",
+        "# #*   #",
+        "#  *#  #",
+        "#@     #",
+        "########",
+    });
+    for (int i = 0; i < 2; i++) REQUIRE(!is_simple_deadlock(BoxAt(level, i), level->start_boxes));
+    Destroy(level);
+
+    // pushing either box sideways is possible
+    level = ParseLevel({
+        "########",
+        "#      #",
+        "#  $   #",
+        "#  $#  #",
+        "#@   ..#",
+        "########",
+    });
+    for (int i = 0; i < 2; i++) REQUIRE(!is_simple_deadlock(BoxAt(level, i), level->start_boxes));
+    Destroy(level);
+}
+
+TEST_CASE("is_simple_deadlock 2x2") {
+    const Level* level = ParseLevel({
+        "#######",
+        "#     #",
+        "# $$  #",
+        "# $$  #",
+        "#@....#",
+        "#######",
+    });
+    for (int i = 0; i < 4; i++) REQUIRE(is_simple_deadlock(BoxAt(level, i), level->start_boxes));
+    Destroy(level);
+}
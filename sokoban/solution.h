@@ -0,0 +1,108 @@
+#pragma once
+#include "sokoban/level.h"
+#include "sokoban/macros.h"
+#include "sokoban/solver.h"
+#include "sokoban/state_map.h"
+#include "sokoban/util.h"
+
+template <typename State>
+pair<State, StateInfo> Previous(pair<State, StateInfo> p, const Level* level, const StateMap<State>& states) {
+    auto [s, si] = p;
+    if (si.distance <= 0) THROW(runtime_error, "non-positive distance");
+    normalize(level, &s.agent, s.boxes);
+
+    State ps;
+    ps.agent = si.prev_agent;
+    ps.boxes = s.boxes;
+    const Cell* a = level->cells[ps.agent];
+    if (!a) THROW(runtime_error, "A null");
+    const Cell* b = a->dir(si.dir);
+    if (!b) THROW(runtime_error, "B null");
+    if (ps.boxes[b->id]) THROW(runtime_error, "box on B");
+    // Box ends on the last filled goal after goal room macro, or on the first box in direction of push otherwise
+    // (further than B->dir(dir) after tunnel macro).
+    const Cell* c = nullptr;
+    if (si.dir & StateInfo::GoalRoomMacro) {
+        for (const Cell* g : level->goal_room_order)
+            if (ps.boxes[g->id]) c = g;
+    } else {
+        c = b->dir(si.dir);
+        while (c && c->alive && !ps.boxes[c->id]) c = c->dir(si.dir);
+    }
+    if (!c) THROW(runtime_error, "C null");
+    if (!c->alive || !ps.boxes[c->id]) THROW(runtime_error, "no box on C");
+    ps.boxes.reset(c->id);
+    ps.boxes.set(b->id);
+    State norm_ps = ps;
+    normalize(level, &norm_ps.agent, norm_ps.boxes);
+    return {ps, states.get(norm_ps)};
+}
+
+// Single pushes of one step of search from state P (with agent on the cell it pushed from) to S, as (agent, dir) of each.
+template <typename State>
+vector<pair<const Cell*, int>> StepPushes(const State& p, const State& s, const StateInfo& si, const Level* level) {
+    const Cell* a = level->cells[p.agent];
+    const int d = si.dir & 3;
+    const Cell* b = a->dir(d);
+    vector<pair<const Cell*, int>> pushes = {{a, d}};
+    if (si.dir & StateInfo::GoalRoomMacro) {
+        const Cell* g = next_room_goal(level, p.boxes);
+        auto boxes = p.boxes;
+        boxes.reset(b->id);
+        if (!g || !pack_box(b, b->dir(d), g, boxes, pushes)) THROW(runtime_error, "goal room macro not found");
+        return pushes;
+    }
+    for (const Cell* c = b; !s.boxes[c->dir(d)->id]; c = c->dir(d)) pushes.emplace_back(c, d);
+    return pushes;
+}
+
+template <typename State>
+Solution ExtractSolution(pair<State, StateInfo> s, const Level* level, const StateMap<State>& states) {
+    Timestamp ts;
+    vector<pair<State, StateInfo>> steps;
+    while (true) {
+        steps.push_back(s);
+        if (s.second.distance == 0) break;
+        s = Previous(s, level, states);
+    }
+    std::reverse(steps.begin(), steps.end());
+
+    // Expand macros. Agent of each state is on the cell it pushes from next, and on the last pushed from cell at the end.
+    vector<DynamicState> result = {steps[0].first};
+    for (int i = 1; i < steps.size(); i++) {
+        DynamicState p = steps[i - 1].first;
+        for (auto [a, d] : StepPushes(steps[i - 1].first, steps[i].first, steps[i].second, level)) {
+            const Cell* b = a->dir(d);
+            result.back().agent = a->id;
+            p.agent = b->id;
+            p.boxes.reset(b->id);
+            p.boxes.set(b->dir(d)->id);
+            result.push_back(p);
+        }
+    }
+    return result;
+}
+
+// Forward pushes from start to S, followed by pushes reversing the pulls of backward search from S to goals.
+// Pulls are only appended if S is the meeting state (forward search may have reached a goal on its own meanwhile).
+template <typename State>
+Solution ExtractSolution(const pair<State, StateInfo>& s, const optional<State>& meeting, const Level* level, const StateMap<State>& states, const StateMap<State>& backward_states) {
+    Solution result = ExtractSolution(s, level, states);
+    if (!meeting.has_value() || !(s.first == *meeting)) return result;
+
+    State x = *meeting;
+    StateInfo xi = backward_states.get(x);
+    while (xi.distance > 0) {
+        const Cell* a = level->cells[xi.prev_agent];
+        // agent pushes box from A to A->dir(dir), from the cell where pull left it
+        result.back().agent = a->dir(xi.dir ^ 2)->id;
+        State y(a->id, x.boxes);
+        y.boxes.reset(a->id);
+        y.boxes.set(a->dir(xi.dir)->id);
+        result.push_back(y);
+        x = y;
+        normalize(level, &x.agent, x.boxes);
+        xi = backward_states.get(x);
+    }
+    return result;
+}
@@ -0,0 +1,88 @@
+#include "sokoban/level_loader.h"
+#include "sokoban/solution.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+// Box is pushed right along the middle row, from S0 to goal G in three pushes:
+//   #######
+//   #     #
+//   #@$  .#
+//   #     #
+//   #######
+// Forward search knows S0, S1 (and maybe G), backward search pulled from G back to S1.
+struct PushRow {
+    const Level* level = ParseLevel({"#######", "#     #", "#@$  .#", "#     #", "#######"});
+    StateMap<DynamicState> states{level}, backward{level};
+    vector<DynamicState> state;  // by number of pushes
+    vector<const Cell*> box;
+    int right = -1;
+
+    PushRow() {
+        for (const Cell* a : level->alive())
+            if (level->start_boxes[a->id]) box.push_back(a);
+        REQUIRE(box.size() == 1);
+        for (int d = 0; d < 4; d++)
+            if (box[0]->dir(d) && box[0]->dir(d)->alive) right = d;
+        for (int i = 0; i < 3; i++) box.push_back(box.back()->dir(right));
+        REQUIRE(box.back()->goal);
+        for (const Cell* b : box) {
+            DynamicState s(b->dir(right ^ 2)->id, DynamicBoxes());
+            s.boxes.set(b->id);
+            normalize(level, &s.agent, s.boxes);
+            state.push_back(s);
+        }
+    }
+
+    ~PushRow() { Destroy(level); }
+
+    // forward: pushed i times, from cell left of the previous box
+    pair<DynamicState, StateInfo> forward(int i) {
+        StateInfo si;
+        si.distance = i;
+        if (i > 0) {
+            si.dir = right;
+            si.prev_agent = box[i - 1]->dir(right ^ 2)->id;
+        }
+        states.add(state[i], si);
+        return {state[i], si};
+    }
+
+    // backward: pulled from goal until box is at i, with pull leaving box at i
+    void pulled(int i) {
+        StateInfo si;
+        si.distance = 3 - i;
+        if (i < 3) {
+            si.dir = right;
+            si.prev_agent = box[i]->id;
+        }
+        backward.add(state[i], si);
+    }
+
+    void check(const Solution& solution) {
+        REQUIRE(solution.size() == 4);
+        for (int i = 0; i < 4; i++) {
+            REQUIRE(solution[i].boxes == state[i].boxes);
+            // agent is on the cell it pushes from next
+            if (i < 3) REQUIRE(solution[i].agent == box[i]->dir(right ^ 2)->id);
+        }
+    }
+};
+
+TEST_CASE("ExtractSolution meeting") {
+    PushRow c;
+    c.forward(0);
+    auto s = c.forward(1);
+    for (int i = 3; i >= 1; i--) c.pulled(i);
+    c.check(ExtractSolution(s, optional(c.state[1]), c.level, c.states, c.backward));
+}
+
+// Forward search reached goal while backward search recorded a different meeting state. Pulls from meeting state must
+// not be appended after the goal.
+TEST_CASE("ExtractSolution goal and meeting") {
+    PushRow c;
+    for (int i = 0; i < 3; i++) c.forward(i);
+    auto g = c.forward(3);
+    for (int i = 3; i >= 1; i--) c.pulled(i);
+    c.check(ExtractSolution(g, optional(c.state[1]), c.level, c.states, c.backward));
+    c.check(ExtractSolution(g, optional<DynamicState>(), c.level, c.states, c.backward));
+}
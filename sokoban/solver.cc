@@ -3,6 +3,7 @@
 #include "core/range.h"
 
 #include "sokoban/common.h"
+#include "sokoban/checkpoint.h"
 #include "sokoban/solver.h"
 #include "sokoban/corrals.h"
 #include "sokoban/frozen.h"
@@ -11,171 +12,14 @@
 #include "sokoban/util.h"
 #include "sokoban/heuristic.h"
 #include "sokoban/state_map.h"
+#include "sokoban/state_queue.h"
 #include "sokoban/level_loader.h"
 #include "sokoban/level_printer.h"
+#include "sokoban/macros.h"
+#include "sokoban/solution.h"
 
 #include "ctpl.h"
 
-template <typename T>
-void ensure_size(vector<T>& vec, size_t s) {
-    if (s > vec.size()) vec.resize(round_up_power2(s));
-}
-
-template <typename State>
-class ConcurrentStateQueue {
-   public:
-    ConcurrentStateQueue(uint concurrency) : _concurrency(concurrency) { queue.resize(256); }
-
-    void push(const State& s, uint priority) {
-        Timestamp lock_ts;
-        queue_lock.lock();
-        _push_overhead += lock_ts.elapsed();
-
-        ensure_size(queue, priority + 1);
-        queue[priority].push_back(s);
-        if (priority < min_queue) min_queue = priority;
-        bool notify = queue_size == 0;
-        queue_size += 1;
-        queue_lock.unlock();
-
-        if (notify) queue_push_cv.notify_all();
-    }
-
-    optional<State> top() const {
-        Timestamp lock_ts;
-        unique_lock<mutex> lk(queue_lock);
-        _pop_overhead += lock_ts.elapsed();
-        if (block_if_empty(lk)) return nullopt;
-        return queue[min_queue][0];
-    }
-
-    optional<State> pop() {
-        Timestamp lock_ts;
-        unique_lock<mutex> lk(queue_lock);
-        _pop_overhead += lock_ts.elapsed();
-        if (block_if_empty(lk)) return nullopt;
-
-        State s = queue[min_queue].front();
-        queue[min_queue].pop_front();
-        queue_size -= 1;
-        return s;
-    }
-
-    size_t size() const {
-        unique_lock<mutex> lk(queue_lock);
-        return queue_size;
-    }
-
-    void shutdown() {
-        unique_lock<mutex> lk(queue_lock);
-        running = false;
-        queue_push_cv.notify_all();
-    }
-
-    template <class Rep, class Period>
-    bool wait_while_running_for(const std::chrono::duration<Rep, Period>& rel_time) const {
-        unique_lock<mutex> lk(queue_lock);
-        if (running) queue_push_cv.wait_for(lk, rel_time);
-        return running;
-    }
-
-    void reset() {
-        running = true;
-        _push_overhead = 0;
-        _pop_overhead = 0;
-        min_queue = 0;
-        blocked_on_queue = 0;
-        queue_size = 0;
-        queue.clear();
-    }
-
-    string monitor() const {
-        unique_lock<mutex> lk(queue_lock);
-        return format("push {:.3f}, pop {:.3f}", Timestamp::to_s(_push_overhead), Timestamp::to_s(_pop_overhead));
-    }
-
-   private:
-    bool block_if_empty(unique_lock<mutex>& lk) const {
-        if (queue_size == 0) {
-            blocked_on_queue += 1;
-            while (queue_size == 0) {
-                if (!running) return true;
-                if (blocked_on_queue >= _concurrency) {
-                    running = false;
-                    queue_push_cv.notify_all();
-                    return true;
-                }
-                queue_push_cv.wait(lk);
-            }
-            blocked_on_queue -= 1;
-        }
-        if (!running) return true;
-        while (queue[min_queue].size() == 0) min_queue += 1;
-        return false;
-    }
-
-    const uint _concurrency;
-
-    mutable bool running = true;
-    mutable long _push_overhead = 0;
-    mutable long _pop_overhead = 0;
-    mutable uint blocked_on_queue = 0;
-    mutable mutex queue_lock;
-    mutable condition_variable queue_push_cv;
-
-    mutable uint min_queue = 0;
-    uint queue_size = 0;
-    vector<array_deque<State>> queue;
-};
-
-template <typename State>
-pair<State, StateInfo> Previous(pair<State, StateInfo> p, const Level* level, const StateMap<State>& states) {
-    auto [s, si] = p;
-    if (si.distance <= 0) THROW(runtime_error, "non-positive distance");
-    normalize(level, &s.agent, s.boxes);
-
-    State ps;
-    ps.agent = si.prev_agent;
-    ps.boxes = s.boxes;
-    const Cell* a = level->cells[ps.agent];
-    if (!a) THROW(runtime_error, "A null");
-    const Cell* b = a->dir(si.dir);
-    if (!b) THROW(runtime_error, "B null");
-    if (ps.boxes[b->id]) THROW(runtime_error, "box on B");
-    const Cell* c = b->dir(si.dir);
-    if (!c) THROW(runtime_error, "C null");
-    if (!ps.boxes[c->id]) THROW(runtime_error, "no box on C");
-    ps.boxes.reset(c->id);
-    ps.boxes.set(b->id);
-    State norm_ps = ps;
-    normalize(level, &norm_ps.agent, norm_ps.boxes);
-    return {ps, states.get(norm_ps, StateMap<State>::shard(norm_ps))};
-}
-
-template <typename State>
-Solution ExtractSolution(pair<State, StateInfo> s, const Level* level, const StateMap<State>& states) {
-    Timestamp ts;
-    vector<DynamicState> result;
-    while (true) {
-        result.push_back(s.first);
-        if (s.second.distance == 0) break;
-        s = Previous(s, level, states);
-    }
-    std::reverse(result.begin(), result.end());
-
-    if (result.size() >= 2) {
-        DynamicState& v = result[result.size() - 2];
-        DynamicState& w = result[result.size() - 1];
-        for (int i = 0; i < level->alive().size(); i++) {
-            if (v.boxes[i] && !w.boxes[i]) {
-                w.agent = i;
-                break;
-            }
-        }
-    }
-    return result;
-}
-
 template <typename State, typename Queue>
 void Monitor(const Timestamp& start_ts, const SolverOptions& options, const Level* level, const StateMap<State>& states, const Queue& queue, DeadlockDB<typename State::Boxes>& deadlock_db, vector<Counters>& counters) {
     Corrals<State> corrals(level);
@@ -214,10 +58,8 @@ void Monitor(const Timestamp& start_ts, const SolverOptions& options, const Leve
                 continue;
             }
 
-            int shard = StateMap<State>::shard(s);
-            states.lock(shard);
-            const StateInfo* si = states.query(s, shard);
-            states.unlock(shard);
+            auto si = states.query(s);
+            if (!si) break;
 
             int priority = int(si->distance) * options.dist_w + int(si->heuristic) * options.heur_w;
             print("distance {}, heuristic {}, priority {}\n", si->distance, si->heuristic, priority);
@@ -226,7 +68,7 @@ void Monitor(const Timestamp& start_ts, const SolverOptions& options, const Leve
 
             /*for_each_push(level, s, [&](const Cell* a, const Cell* b, int d) {
                 const Cell* c = b->dir(d);
-                if (corrals.has_picorral() && !corrals.picorral()[c->id]) return;
+                if (corrals.has_picorral() && !corrals.in_picorral(c)) return;
                 State ns(b->id, s.boxes);
                 ns.boxes.reset(b->id);
                 ns.boxes.set(c->id);
@@ -302,109 +144,314 @@ struct Protected {
 template <typename State>
 struct Solver {
     using Boxes = typename State::Boxes;
+    using Key = typename StateMap<State>::Key;
+
+    // Popped states of one worker, which may have children missing from checkpoint being written.
+    struct alignas(64) InFlight {
+        mutex lock;
+        optional<State> expanding;  // last popped state
+        vector<State> popped;       // while checkpointing
+    };
 
     const int concurrency;
     const SolverOptions options;
 
     const Level* level;
     StateMap<State> states;
-    ConcurrentStateQueue<State> queue;
+    WorkStealingQueue<State> queue;
     vector<Counters> counters;
     Boxes goals;
     DeadlockDB<Boxes> deadlock_db;
+    unique_ptr<PatternDB> pattern_db;
+
+    atomic<bool> checkpointing = false;
+    unique_ptr<InFlight[]> in_flight;
+
+    // Search by pulls from goal states. StateInfo of backward state describes the pull which reached it: box was
+    // pulled from prev_agent->dir(dir) to prev_agent (so it is the push in the opposite direction).
+    struct Backward {
+        StateMap<State> states;
+        WorkStealingQueue<State> queue;
+        vector<uint> start_distance;  // by alive cell, min pushes from any start box (heuristic)
+
+        Backward(const Level* level, const SolverOptions& options) : states(level, options.compact_states), queue(options.backward_threads) {}
+    };
+    unique_ptr<Backward> backward;
+    Protected<optional<State>> meeting;  // state in both forward and backward StateMap
 
     Solver(const Level* level, const SolverOptions& options)
-            : concurrency(options.single_thread ? 1 : thread::hardware_concurrency())
+            : concurrency(options.single_thread ? 1 : (options.threads > 0 ? options.threads : thread::hardware_concurrency()))
             , options(options)
             , level(level)
-            , queue(concurrency)
-            , deadlock_db(level) {
+            , states(level, options.compact_states, options.verify_states)
+            , queue(concurrency, (long(options.queue_memory_mb) << 20) / sizeof(State))
+            , deadlock_db(level, options.persistent_deadlocks, options.local_patterns)
+            , in_flight(new InFlight[concurrency]) {
         for (Cell* c : level->goals()) goals.set(c->id);
+        if (options.pattern_db) {
+            pattern_db = std::make_unique<PatternDB>(level, true, concurrency, options.verbosity);
+            if (pattern_db->empty()) pattern_db.reset();
+        }
+        if (options.backward_threads > 0) {
+            // with extra goals, every subset of goals would be a goal state
+            if (level->num_boxes == level->num_goals)
+                InitBackward();
+            else if (options.verbosity > 0)
+                print(warning, "Warning: no backward search, as there are more goals than boxes\n");
+        }
+    }
+
+    // Forward push distances from start boxes (as in ComputePushDistances, but for pushes from start boxes).
+    void InitBackward() {
+        backward = std::make_unique<Backward>(level, options);
+        auto& start_distance = backward->start_distance;
+        start_distance.resize(level->num_alive, Cell::Inf);
+
+        matrix<uint> distance;
+        distance.resize(level->cells.size(), level->num_alive);
+        distance.fill(Cell::Inf);
+        AgentBoxVisitor visitor(level);
+        for (const Cell* b : level->alive())
+            if (level->start_boxes[b->id])
+                for (auto [_, a] : b->moves)
+                    if (visitor.add(a, b)) distance(a->id, b->id) = 0;
+
+        for (auto [a, b] : visitor) {
+            minimize(start_distance[b->id], distance(a->id, b->id));
+            for (auto [d, n] : a->moves) {
+                if (n != b && visitor.add(n, b))
+                    distance(n->id, b->id) = distance(a->id, b->id);  // no move cost
+                const Cell* c = b->dir(d);
+                if (n == b && c && c->alive && visitor.add(b, c))
+                    distance(b->id, c->id) = distance(a->id, b->id) + 1;  // push cost
+            }
+        }
+    }
+
+    // Goal states, one for each agent region.
+    void StartBackward() {
+        const Bitboard& bitboard = level->bitboard;
+        Bitboard::Bits box_bits, visited, region;
+        bitboard.boxes(goals, box_bits);
+        bitboard.clear(visited);
+        uint h = 0;
+        for (const Cell* g : level->goals()) {
+            // no box can reach G, so backward search ends at once (and stops forward search)
+            if (backward->start_distance[g->id] == Cell::Inf) return;
+            h += backward->start_distance[g->id];
+        }
+        StateInfo si;
+        si.heuristic = h;
+        for (const Cell* c : level->cells) {
+            if ((c->alive && goals[c->id]) || Bitboard::test(visited, c->xy)) continue;
+            bitboard.fill(c->xy, box_bits, region);
+            for (int i = 0; i < bitboard.words(); i++) visited[i] |= region[i];
+            const State s(bitboard.lowest(region)->id, goals);
+            backward->states.add(s, si);
+            backward->queue.push(s, Priority(si));
+        }
+    }
+
+    // Called by both searches after inserting a new state to their StateMap. Fence orders insert before lookup in the
+    // other map, so that if two threads insert the same state at the same time, at least one of them sees both.
+    void CheckMeeting(const State& s, const Key& key, const StateMap<State>& other) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!other.contains(key)) return;
+        queue.shutdown();
+        backward->queue.shutdown();
+        unique_lock<mutex> lock(meeting._mutex);
+        if (!meeting._data.has_value()) meeting._data = s;
+    }
+
+    void ExpandBackward(const State& s, const StateInfo& si, vector<pair<State, uint>>& pushes) {
+        auto& bstates = backward->states;
+        const auto& start_distance = backward->start_distance;
+        pushes.clear();
+        for_each_pull(level, s, [&](const Cell* a, const Cell* b, int d) {
+            // box on A can't be pushed there from any start box
+            if (start_distance[a->id] == Cell::Inf) return;
+            State ns(a->dir(d ^ 2)->id, s.boxes);
+            ns.boxes.reset(b->id);
+            ns.boxes.set(a->id);
+            normalize(level, &ns.agent, ns.boxes);
+
+            StateInfo nsi;
+            nsi.dir = d;
+            nsi.distance = si.distance + 1;
+            nsi.prev_agent = a->id;
+            nsi.heuristic = si.heuristic - start_distance[b->id] + start_distance[a->id];
+
+            const Key key = bstates.key(ns);
+            if (!bstates.add(key, nsi)) {
+                optional<StateInfo> updated = bstates.improve(key, nsi);
+                if (updated) pushes.emplace_back(ns, Priority(*updated));
+                return;
+            }
+            pushes.emplace_back(ns, Priority(nsi));
+            CheckMeeting(ns, key, states);
+        });
+        backward->queue.push(pushes);
+    }
+
+    // If backward search runs out of states without meeting, then start state is not reachable from goals.
+    void BackwardSearch(const optional<Timestamp>& end_ts) {
+        atomic<bool> timed_out = false;
+        parallel(options.backward_threads, [&](size_t thread_id) {
+            vector<pair<State, uint>> pushes;
+            while (true) {
+                if (end_ts.has_value() && Timestamp().ticks() >= end_ts->ticks()) {
+                    timed_out = true;
+                    break;
+                }
+                optional<State> s = backward->queue.pop();
+                if (!s) break;
+                optional<StateInfo> si = backward->states.close(*s);
+                if (si) ExpandBackward(*s, *si, pushes);
+            }
+        });
+        // Otherwise backward search was stopped by meeting (which already stopped forward search), by end of forward
+        // search, or by time limit (which forward search checks on its own).
+        if (!timed_out && backward->queue.size() == 0) queue.shutdown();
     }
 
+    Solution ExtractSolution(const pair<State, StateInfo>& s) const {
+        if (!backward) return ::ExtractSolution(s, level, states);
+        return ::ExtractSolution(s, meeting._data, level, states, backward->states);
+    }
+
+    int box_words() const { return std::max(1, (level->num_alive + 31) / 32); }
+
     optional<pair<State, StateInfo>> queue_pop() {
         while (true) {
             optional<State> s = queue.pop();
             if (!s) return nullopt;
 
-            int shard = StateMap<State>::shard(*s);
-            states.lock2(shard);
-            StateInfo* q = states.query(*s, shard);
-            if (!q || q->closed) {
-                states.unlock(shard);
-                continue;
-            }
-            StateInfo si = *q;  // copy before unlock
-            q->closed = true;
-            states.unlock(shard);
-            return pair<State, StateInfo>{*s, si};
+            optional<StateInfo> si = states.close(*s);
+            if (!si) continue;
+            return pair<State, StateInfo>{*s, *si};
         }
     }
 
+    struct Child {
+        State state;
+        Key key;
+        const Cell* from;  // pushed box before push
+        const Cell* box;   // pushed box
+        StateInfo info;
+    };
+
     struct WorkerState {
         Corrals<State> corrals;
+        IncrementalHeuristic<Boxes> heuristic;
+        MatchingHeuristic<Boxes> matching;
         Counters* counters = nullptr;
         Protected<optional<pair<State, StateInfo>>>* result = nullptr;
 
-        WorkerState(const Level* level) : corrals(level) {}
+        // reused between expansions
+        Bitboard::Bits reachable;  // by agent in expanded state
+        vector<Child> children;
+        vector<pair<State, uint>> pushes;
+        vector<pair<const Cell*, int>> macro;
+
+        WorkerState(const Level* level, const PatternDB* pattern_db) : corrals(level), heuristic(level, pattern_db), matching(level) {}
     };
 
-    // Returns false is push is a deadlock.
-    bool EvaluatePush(const State& s, const StateInfo& si, const Cell* a, const Cell* b, const int d, WorkerState& ws) {
+    uint Priority(const StateInfo& si) const { return uint(si.distance) * options.dist_w + uint(si.heuristic) * options.heur_w; }
+
+    // Re-queue existing state if it was reached with fewer pushes.
+    void UpdateDistance(const Child& child, WorkerState& ws) {
+        optional<StateInfo> updated = states.improve(child.key, child.info);
+        if (!updated) return;
+        // no need to update heuristic
+        ws.pushes.emplace_back(child.state, Priority(*updated));
+        ws.counters->updates += 1;
+    }
+
+    // Phase 1: creates normalized child state with its key, and prefetches its record in StateMap.
+    // Returns false if push is cut by PI-corral.
+    bool CollectPush(const State& s, const StateInfo& si, const Cell* a, const Cell* b, const int d, WorkerState& ws) {
         Counters& q = *ws.counters;
         const Cell* c = b->dir(d);
-        if (ws.corrals.has_picorral() && !ws.corrals.picorral()[c->id]) {
+        if (ws.corrals.has_picorral() && !ws.corrals.in_picorral(c)) {
             q.corral_cuts += 1;
-            return true;
+            return false;
         }
-        State ns(b->id, s.boxes);
+        StateInfo nsi;
+        nsi.dir = d;
+        nsi.distance = si.distance + 1;
+        nsi.prev_agent = a->id;
+
+        // Box ends on C and agent on B, unless push is extended by macro.
+        const Cell* agent = b;
+        const Cell* g = nullptr;
+        if (options.goal_room_macros && c == level->goal_room_entrance && !b->goal_room) g = next_room_goal(level, s.boxes);
+        if (g) {
+            ws.macro.clear();
+            Boxes others = s.boxes;
+            others.reset(b->id);
+            if (pack_box(b, c, g, others, ws.macro)) {
+                nsi.dir |= StateInfo::GoalRoomMacro;
+                nsi.distance += ws.macro.size();
+                agent = ws.macro.back().first->dir(ws.macro.back().second);
+                c = g;
+                q.macros += 1;
+            }
+        } else if (options.tunnel_macros) {
+            if (const Cell* e = tunnel_push(b, d, s.boxes); e != c) {
+                for (const Cell* x = c; x != e; x = x->dir(d)) nsi.distance += 1;
+                agent = e->dir(d ^ 2);
+                c = e;
+                q.macros += 1;
+            }
+        }
+
+        State ns(agent->id, s.boxes);
         ns.boxes.reset(b->id);
         ns.boxes.set(c->id);
 
-        if (deadlock_db.is_deadlock(ns.agent, ns.boxes, c, q)) return false;
-
         Timestamp norm_ts;
-        normalize(level, &ns.agent, ns.boxes);
+        if (agent != b)
+            normalize(level, &ns.agent, ns.boxes);
+        else if (normalize_push(level, ws.reachable, b, c, ns.boxes, &ns.agent))
+            q.norm_incremental += 1;
+        q.norm_total += 1;
 
         Timestamp states_query_ts;
         q.norm_ticks += norm_ts.elapsed(states_query_ts);
 
-        int shard = StateMap<State>::shard(ns);
-        states.lock(shard);
+        Key key = states.key(ns);
+        states.prefetch(key);
+        states.verify(ns, key);
+        ws.children.push_back(Child{std::move(ns), std::move(key), b, c, nsi});
+        q.state_ticks += states_query_ts.elapsed();
+        return true;
+    }
 
-        StateInfo* qs = states.query(ns, shard);
-        if (qs) {
+    // Phase 2: evaluates one collected child. Returns false if it is a deadlock.
+    bool EvaluateChild(Child& child, WorkerState& ws) {
+        Counters& q = *ws.counters;
+        const State& ns = child.state;
+        StateInfo& nsi = child.info;
+
+        // Optimistic lookup. Known states skip deadlock checks and heuristic.
+        Timestamp states_query_ts;
+        if (states.contains(child.key)) {
             q.duplicates += 1;
-            if (si.distance + 1 >= qs->distance) {
-                // existing state
-                states.unlock(shard);
-            } else {
-                qs->dir = d;
-                qs->distance = si.distance + 1;
-                // no need to update heuristic
-                qs->prev_agent = b->dir(d ^ 2)->id;
-                states.unlock(shard);
-                queue.push(ns, uint(qs->distance) * options.dist_w + uint(qs->heuristic) * options.heur_w);
-                q.updates += 1;
-            }
+            UpdateDistance(child, ws);
             q.state_ticks += states_query_ts.elapsed();
             return true;
         }
+        Timestamp evaluate_ts;
+        q.state_ticks += states_query_ts.elapsed(evaluate_ts);
 
-        // new state
-        StateInfo nsi;
-        nsi.dir = d;
-        nsi.distance = si.distance + 1;
+        // Evaluate new state without holding anything (normalized agent is in the same region).
+        if (deadlock_db.is_deadlock(ns.agent, ns.boxes, child.box, q)) return false;
 
         Timestamp heuristic_ts;
-        q.state_ticks += states_query_ts.elapsed(heuristic_ts);
-
-        // TODO holding lock while computing heuristic!
-        uint h = heuristic(level, ns.boxes);
+        uint h = options.matching_heuristic ? ws.matching.push(ns.boxes, child.from, child.box) : ws.heuristic.push(ns.boxes, child.from, child.box);
         q.heuristic_ticks += heuristic_ts.elapsed();
 
         if (h == Cell::Inf) {
-            states.unlock(shard);
             q.heuristic_deadlocks += 1;
             deadlock_db.add_deadlock(ns.agent, ns.boxes);
             return false;
@@ -412,17 +459,20 @@ struct Solver {
         if (h > std::numeric_limits<decltype(nsi.heuristic)>::max()) THROW(runtime_error, "heuristic overflow {}", h);
         nsi.heuristic = h;
 
-        nsi.prev_agent = b->dir(d ^ 2)->id;
-
+        // Insert or merge.
         Timestamp state_insert_ts;
-        states.add(ns, nsi, shard);
-        states.unlock(shard);
-
-        Timestamp queue_push_ts;
-        q.state_insert_ticks += state_insert_ts.elapsed(queue_push_ts);
-
-        queue.push(ns, int(nsi.distance) * options.dist_w + int(nsi.heuristic) * options.heur_w);
-        q.queue_ticks += queue_push_ts.elapsed();
+        if (!states.add(child.key, nsi)) {
+            // other thread added it in the meantime, evaluation was wasted
+            q.lost_races += 1;
+            q.lost_race_ticks += evaluate_ts.elapsed(state_insert_ts);
+            q.duplicates += 1;
+            UpdateDistance(child, ws);
+            q.state_insert_ticks += state_insert_ts.elapsed();
+            return true;
+        }
+        q.state_insert_ticks += state_insert_ts.elapsed();
+        ws.pushes.emplace_back(ns, Priority(nsi));
+        if (backward) CheckMeeting(ns, child.key, backward->states);
 
         if (options.debug) {
             print("child:\n");
@@ -438,27 +488,210 @@ struct Solver {
         return true;
     }
 
+    // Collects all children of s into a batch (so that StateMap lookups overlap their cache misses),
+    // evaluates them and pushes new ones to the queue at once. Returns false if all pushes are deadlocks.
+    bool Expand(const State& s, const StateInfo& si, WorkerState& ws) {
+        Counters& q = *ws.counters;
+        ws.children.clear();
+        ws.pushes.clear();
+        Timestamp heuristic_ts;
+        if (options.matching_heuristic)
+            ws.matching.set_parent(s.boxes);
+        else
+            ws.heuristic.set_parent(s.boxes, si.heuristic);
+        q.heuristic_ticks += heuristic_ts.elapsed();
+
+        bool deadlock = true;
+        for_each_push(level, s, ws.reachable, [&](const Cell* a, const Cell* b, int d) {
+            if (!CollectPush(s, si, a, b, d, ws)) deadlock = false;
+        });
+        for (Child& child : ws.children)
+            if (EvaluateChild(child, ws)) deadlock = false;
+
+        Timestamp queue_push_ts;
+        queue.push(ws.pushes);
+        q.queue_ticks += queue_push_ts.elapsed();
+        q.heuristic_recomputes = ws.heuristic.full_updates() + ws.matching.full_updates();
+        return !deadlock;
+    }
+
+    // Writes StateMap, open states and deadlock patterns to CheckpointFilename(level), while workers keep running.
+    //
+    // StateMap and queue are copied in chunks, so they are not consistent: a state popped during checkpoint can be
+    // closed in it, while some of its children are missing, or are open but not in the queue. Workers track such
+    // states (and states which were being expanded when checkpoint started), and Resume() re-opens them.
+    void Checkpoint() {
+        Timestamp checkpoint_ts;
+        std::filesystem::create_directories(kCheckpointPath);
+        const string filename = CheckpointFilename(level);
+        const string tmp_filename = filename + ".tmp";
+        std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+
+        vector<State> reopen;
+        checkpointing = true;
+        for (int i = 0; i < concurrency; i++) {
+            unique_lock lock(in_flight[i].lock);
+            if (in_flight[i].expanding) reopen.push_back(*in_flight[i].expanding);
+        }
+
+        WritePod(out, kCheckpointMagic);
+        WritePod<ulong>(out, CheckpointHash(level));
+        WritePod<int>(out, box_words());
+        states.save(out);
+        WriteSection(out, [&]() {
+            long count = 0;
+            queue.for_each([&](const State& s, uint priority) {
+                WritePod<uint>(out, priority);
+                WriteState(out, s, box_words());
+                count += 1;
+            });
+            return count;
+        });
+
+        checkpointing = false;
+        for (int i = 0; i < concurrency; i++) {
+            unique_lock lock(in_flight[i].lock);
+            for (const State& s : in_flight[i].popped) reopen.push_back(s);
+            in_flight[i].popped.clear();
+        }
+        WriteSection(out, [&]() {
+            for (const State& s : reopen) WriteState(out, s, box_words());
+            return long(reopen.size());
+        });
+        deadlock_db.save(out);
+
+        const auto size = out.tellp();
+        out.close();
+        if (!out) THROW(runtime_error, "failed to write {}", tmp_filename);
+        // StateMap::save() could have started over with fewer records, leaving garbage at the end
+        std::filesystem::resize_file(tmp_filename, size);
+        std::filesystem::rename(tmp_filename, filename);
+        if (options.verbosity > 0) print("checkpoint {} ({} MB) in {:.3f}s\n", filename, long(size) >> 20, checkpoint_ts.elapsed_s());
+    }
+
+    // Loads checkpoint of level into empty solver. Returns false if there is no (compatible) checkpoint.
+    // Truncated or corrupt checkpoint is ignored too, after removing whatever was loaded from it.
+    bool Resume() {
+        const string filename = CheckpointFilename(level);
+        if (!std::filesystem::exists(filename)) return false;
+        std::ifstream in(filename, std::ios::binary);
+        try {
+            if (LoadCheckpoint(in)) {
+                if (options.verbosity > 0) print("resumed from {}: states {}, open {}\n", filename, states.size(), queue.size());
+                return true;
+            }
+            print(warning, "Warning: ignoring incompatible checkpoint {}\n", filename);
+        } catch (const std::exception&) {
+            print(warning, "Warning: ignoring corrupt checkpoint {}\n", filename);
+        }
+        states.reset();
+        queue.reset();
+        return false;
+    }
+
+    bool LoadCheckpoint(std::istream& in) {
+        if (ReadPod<ulong>(in) != kCheckpointMagic || ReadPod<ulong>(in) != CheckpointHash(level) || ReadPod<int>(in) != box_words() || !states.load(in)) return false;
+
+        vector<pair<State, uint>> batch;
+        auto flush = [&]() {
+            queue.push(batch);
+            batch.clear();
+        };
+        for (long count = ReadPod<long>(in); count > 0; count--) {
+            const uint priority = ReadPod<uint>(in);
+            batch.emplace_back(ReadState<State>(in, box_words()), priority);
+            if (batch.size() >= 4096) flush();
+        }
+
+        // Re-opened state is expanded again, which adds its missing children. Its existing open children are queued
+        // here, as expansion only re-queues children whose distance improved. Children are collected the same way as
+        // in Expand(), so that they include macro pushes.
+        Counters q;
+        WorkerState ws(level, pattern_db.get());
+        ws.counters = &q;
+        for (long count = ReadPod<long>(in); count > 0; count--) {
+            const State s = ReadState<State>(in, box_words());
+            optional<StateInfo> si = states.reopen(s);
+            if (!si) continue;
+            batch.emplace_back(s, Priority(*si));
+            ws.children.clear();
+            ws.corrals.find_unsolved_picorral(s);
+            for_each_push(level, s, ws.reachable, [&](const Cell* a, const Cell* b, int d) { CollectPush(s, *si, a, b, d, ws); });
+            for (const Child& child : ws.children) {
+                optional<StateInfo> nsi = states.query(child.key);
+                if (nsi && !nsi->closed) batch.emplace_back(child.state, Priority(*nsi));
+            }
+            if (batch.size() >= 4096) flush();
+        }
+        flush();
+        deadlock_db.load(in);
+        return true;
+    }
+
+    // Checkpoint failure (ie. full disk) only skips this checkpoint, as search can still finish without it.
+    void TryCheckpoint() {
+        try {
+            Checkpoint();
+        } catch (const std::exception& e) {
+            print(warning, "Warning: checkpoint failed: {}\n", e.what());
+        }
+    }
+
+    // Writes checkpoint every checkpoint_period seconds while search is running. On SIGTERM, it writes the last
+    // checkpoint and terminates the process. Previous SIGTERM handler is restored once search is done.
+    void CheckpointLoop() {
+        if (options.checkpoint_period <= 0) return;
+        SigtermHandler sigterm;
+        Timestamp checkpoint_ts;
+        while (queue.wait_while_running_for(1s)) {
+            if (g_sigterm) {
+                TryCheckpoint();
+                std::signal(SIGTERM, SIG_DFL);
+                std::raise(SIGTERM);
+            }
+            if (checkpoint_ts.elapsed_s() >= options.checkpoint_period) {
+                TryCheckpoint();
+                checkpoint_ts = Timestamp();
+            }
+        }
+    }
+
     optional<pair<State, StateInfo>> Solve(State start, bool pre_normalize = true) {
-        if (concurrency == 1) print(warning, "Warning: Single-threaded!\n");
+        if (concurrency == 1 && options.verbosity > 0) print(warning, "Warning: Single-threaded!\n");
         Timestamp start_ts;
         optional<Timestamp> end_ts;
         if (options.max_time != 0) end_ts = Timestamp(start_ts.ticks() + ulong(options.max_time / Timestamp::ms_per_tick() * 1000));
         atomic<bool> timed_out = false;
 
         if (pre_normalize) normalize(level, &start.agent, start.boxes);
-        states.add(start, StateInfo(), StateMap<State>::shard(start));
-        queue.push(start, 0);
+        // children compute their heuristic incrementally from this one
+        StateInfo start_info;
+        uint h = options.matching_heuristic ? MatchingHeuristic<Boxes>(level).full(start.boxes) : heuristic(level, start.boxes, pattern_db.get());
+        if (h == Cell::Inf) return nullopt;
+        if (h > std::numeric_limits<decltype(start_info.heuristic)>::max()) THROW(runtime_error, "heuristic overflow {}", h);
+        start_info.heuristic = h;
+        if (!options.resume || !Resume()) {
+            states.verify(start, states.key(start));
+            states.add(start, start_info);
+            queue.push(start, 0);
+        }
 
         if (start.boxes == goals) return pair<State, StateInfo>{start, StateInfo()};
 
         Protected<optional<pair<State, StateInfo>>> result;
 
-        counters.resize(thread::hardware_concurrency());
+        counters.resize(concurrency);
         thread monitor([this, start_ts]() { Monitor(start_ts, options, level, states, queue, deadlock_db, counters); });
+        thread checkpoint([this]() { CheckpointLoop(); });
+        thread backward_search;
+        if (backward) {
+            StartBackward();
+            backward_search = thread([this, end_ts]() { BackwardSearch(end_ts); });
+        }
 
         parallel(concurrency, [&](size_t thread_id) {
             Counters& q = counters[thread_id];
-            WorkerState ws(level);
+            WorkerState ws(level, pattern_db.get());
             ws.result = &result;
             ws.counters = &q;
 
@@ -474,6 +707,12 @@ struct Solver {
                 auto p = queue_pop();
                 if (!p) return;
                 const State& s = p->first;
+                if (options.checkpoint_period > 0) {
+                    InFlight& f = in_flight[thread_id];
+                    unique_lock lock(f.lock);
+                    f.expanding = s;
+                    if (checkpointing) f.popped.push_back(s);
+                }
                 if (deadlock_db.is_complex_deadlock(s.agent, s.boxes, q)) continue;
                 const StateInfo& si = p->second;
 
@@ -490,15 +729,26 @@ struct Solver {
                 ws.corrals.find_unsolved_picorral(s);
                 q.corral_ticks += corral_ts.elapsed();
 
-                bool deadlock = true;
-                for_each_push(level, s, [&](const Cell* a, const Cell* b, int d) {
-                    if (EvaluatePush(s, si, a, b, d, ws)) deadlock = false;
-                });
-                if (deadlock) deadlock_db.add_deadlock(s.agent, s.boxes);
+                if (!Expand(s, si, ws)) deadlock_db.add_deadlock(s.agent, s.boxes);
             }
         });
+        if (backward) {
+            backward->queue.shutdown();
+            backward_search.join();
+        }
         monitor.join();
+        checkpoint.join();
         if (timed_out) print(warning, "Out of time!\n");
+        if (options.checkpoint_period > 0) {
+            // If search is over, checkpoint would only resume into the same result.
+            if (timed_out)
+                TryCheckpoint();
+            else
+                std::filesystem::remove(CheckpointFilename(level));
+        }
+        if (options.verify_states && options.verbosity > 0) print("fingerprint collisions {}\n", states.collisions());
+        if (backward && options.verbosity > 0) print("backward states {}, met {}\n", backward->states.size(), meeting._data.has_value());
+        if (!result._data.has_value() && meeting._data.has_value()) return pair<State, StateInfo>{*meeting._data, states.get(*meeting._data)};
         return result._data;
     }
 };
@@ -523,7 +773,7 @@ struct AltSolver {
             : concurrency(options.single_thread ? 1 : thread::hardware_concurrency())
             , options(options)
             , level(level)
-            , deadlock_db(level)
+            , deadlock_db(level, options.persistent_deadlocks, options.local_patterns)
             , pool(concurrency) {
         for (Cell* c : level->goals()) goals.set(c->id);
     }
@@ -545,7 +795,7 @@ struct AltSolver {
     // Returns false is push is a deadlock.
     bool EvaluatePush(const State& s, const StateInfo& si, const Corrals<State>& corrals, const Cell* a, const Cell* b, const int d, Counters& q, Protected<optional<pair<State, StateInfo>>>& result) {
         const Cell* c = b->dir(d);
-        if (corrals.has_picorral() && !corrals.picorral()[c->id]) {
+        if (corrals.has_picorral() && !corrals.in_picorral(c)) {
             q.corral_cuts += 1;
             return true;
         }
@@ -624,7 +874,7 @@ struct AltSolver {
     }
 
     optional<pair<State, StateInfo>> Solve(State start, bool pre_normalize = true) {
-        if (concurrency == 1) print(warning, "Warning: Single-threaded!\n");
+        if (concurrency == 1 && options.verbosity > 0) print(warning, "Warning: Single-threaded!\n");
         Timestamp start_ts;
         optional<Timestamp> end_ts;
         if (options.max_time != 0) end_ts = Timestamp(start_ts.ticks() + ulong(options.max_time / Timestamp::ms_per_tick() * 1000));
@@ -683,7 +933,7 @@ struct AltSolver {
 #endif
 
 template <typename Boxes>
-Solution InternalSolve(const Level* level, const SolverOptions& options) {
+Solution InternalSolve(const Level* level, const SolverOptions& options, SolverStats* stats) {
     if (options.verbosity > 0) PrintInfo(level);
 
     if (false && options.alt) {
@@ -693,29 +943,49 @@ Solution InternalSolve(const Level* level, const SolverOptions& options) {
         if (solution) return ExtractSolution(*solution, level, solver.states);
 #endif
     } else {
+        Timestamp start_ts;
         Solver<TState<Boxes>> solver(level, options);
         auto solution = solver.Solve(TState(level->start_agent, level->start_boxes));
-        if (solution) return ExtractSolution(*solution, level, solver.states);
+        if (stats) {
+            stats->elapsed_s = start_ts.elapsed_s();
+            stats->states = solver.states.size() + (solver.backward ? solver.backward->states.size() : 0);
+        }
+        if (solution) {
+            Solution pushes = solver.ExtractSolution(*solution);
+            if (stats) stats->pushes = pushes.size() - 1;
+            return pushes;
+        }
     }
     return {};
 }
 
-Solution Solve(const Level* level, const SolverOptions& options) {
+Solution Solve(const Level* level, const SolverOptions& options, SolverStats* stats = nullptr) {
+    // Smallest width which fits all alive cells, so states are not hashed, compared and copied at 1024 bits.
+    // Not every width from 1 to 32 is instantiated, as each one is a full copy of the solver.
 #define DENSE(N) \
-    if (level->num_alive <= 32 * N) { print("Using DenseBoxes<{}>\n", N); return InternalSolve<DenseBoxes<N>>(level, options); }
+    if (level->num_alive <= 32 * N) { if (options.verbosity > 0) print("Using DenseBoxes<{}>\n", N); return InternalSolve<DenseBoxes<N>>(level, options, stats); }
 
     DENSE(1);
     DENSE(2);
     DENSE(3);
     DENSE(4);
-//    DENSE(5);
-//    DENSE(6);
-//    DENSE(7);
-//    DENSE(8);
+    DENSE(5);
+    DENSE(6);
+    DENSE(8);
+    DENSE(12);
+    DENSE(16);
+    DENSE(24);
+    DENSE(32);
 #undef DENSE
 
     print(warning, "Warning: Using DynamicBoxes\n");
-    return InternalSolve<DynamicBoxes>(level, options);
+    return InternalSolve<DynamicBoxes>(level, options, stats);
+}
+
+SolverStats Benchmark(const Level* level, const SolverOptions& options) {
+    SolverStats stats;
+    Solve(level, options, &stats);
+    return stats;
 }
 
 template<typename Boxes>
@@ -833,14 +1103,14 @@ void generate_deadlocks(const Level* level, const SolverOptions& options, int nu
                         s.boxes = my_boxes;
                         s.agent = a->id;
 
-                        // Normalize s (without clearing visitor)
+                        // Mark area of A as visited (without clearing visitor), and normalize s as StateMap does
                         visitor.add(a);
                         for (const Cell* ea : visitor) {
-                            if (ea->id < s.agent) s.agent = ea->id;
                             for (const Cell* eb : ea->new_moves) {
                                 if (!s.boxes[eb->id]) visitor.add(eb);
                             }
                         }
+                        normalize(level, &s.agent, s.boxes);
 
                         for (const Cell* c : a->new_moves)
                             if (!my_boxes[c->id]) {
@@ -881,7 +1151,8 @@ void InternalGenerateDeadlocks(const Level* level, const SolverOptions& options)
     using State = TState<DynamicBoxes>;
     // using State = TState<SparseBoxes<Cell, MaxBoxes>>;
     vector<State> deadlocks;
-    for (auto boxes : range(1, MaxBoxes + 1)) generate_deadlocks(level, options, boxes, deadlocks);
+    // states with more boxes than goals can't be solved
+    for (auto boxes : range(1, std::min(MaxBoxes, level->num_goals) + 1)) generate_deadlocks(level, options, boxes, deadlocks);
     print("found deadlocks {} in {}\n", deadlocks.size(), ts.elapsed());
 }
 
@@ -2,6 +2,7 @@
 #include "sokoban/level_env.h"
 #include "sokoban/level.h"
 #include "sokoban/state.h"
+#include <string>
 #include <vector>
 
 using Solution = std::vector<DynamicState>;
@@ -9,8 +10,21 @@ using Solution = std::vector<DynamicState>;
 struct SolverOptions {
     int verbosity = 2;
     bool single_thread = false;
+    int threads = 0;  // 0 means thread::hardware_concurrency()
     int dist_w = 1;
     int heur_w = 3;
+    bool matching_heuristic = false;  // min cost matching of boxes to goals (instead of nearest goal for each box)
+    bool pattern_db = false;  // add pair interactions to heuristic, from table in /tmp/sokoban/pattern_db (not with matching_heuristic)
+    bool persistent_deadlocks = false;  // load and save deadlock patterns in /tmp/sokoban/deadlocks
+    std::string local_patterns;  // directory with board-local deadlock patterns from 4x5, ie. /tmp/sokoban/patterns (empty for none)
+    bool compact_states = false;  // StateMap stores 64 bit fingerprints instead of packed boxes
+    bool verify_states = false;  // count fingerprint collisions of compact_states (keeps all states in memory)
+    int queue_memory_mb = 0;  // open states above this are spilled to /tmp/sokoban/queue (0 for no limit)
+    int checkpoint_period = 0;  // seconds between checkpoints in /tmp/sokoban/checkpoints, also written on SIGTERM (0 for none)
+    bool resume = false;  // continue from checkpoint of the same level (if there is one)
+    int backward_threads = 0;  // extra threads searching by pulls from goal states, until both searches meet (0 for none)
+    bool tunnel_macros = false;  // push box through tunnel in one step (see macros.h)
+    bool goal_room_macros = false;  // push box from goal room entrance to its goal in one step, can cut off solutions (see macros.h)
     bool alt = false;
     bool monitor = true;
     bool debug = false;
@@ -19,4 +33,13 @@ struct SolverOptions {
 
 std::pair<std::vector<int2>, int> Solve(LevelEnv env, const SolverOptions& options);
 
+struct SolverStats {
+    long states = 0;  // total number of states in StateMap
+    int pushes = 0;   // 0 if not solved
+    double elapsed_s = 0;
+};
+
+// Search only (without extracting moves). Used for benchmarks.
+SolverStats Benchmark(const Level* level, const SolverOptions& options);
+
 void GenerateDeadlocks(const Level* level, const SolverOptions& options);
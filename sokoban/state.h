@@ -35,6 +35,8 @@ struct hash<TState<TBoxes>> {
 using DynamicState = TState<DynamicBoxes>;
 
 struct StateInfo {
+    constexpr static char GoalRoomMacro = 4;  // flag in dir (see pack_box)
+
     ushort distance = 0;   // pushes so far
     ushort heuristic = 0;  // estimated pushes remaining
     char dir = -1;
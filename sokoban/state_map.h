@@ -1,81 +1,427 @@
 #pragma once
 #include "core/thread.h"
 #include "core/timestamp.h"
-#include "absl/container/flat_hash_map.h"
+#include "core/murmur3.h"
+#include "sokoban/checkpoint.h"
+#include "sokoban/level.h"
+#include "sokoban/state.h"
 
+#include <bit>
+
+// Key words stored inline (without heap allocation): all packed boxes for DenseBoxes, or compact hash.
+template <typename Boxes>
+struct InlineKeyWords {
+    constexpr static int value = 8;
+};
+
+template <int Words>
+struct InlineKeyWords<DenseBoxes<Words>> {
+    constexpr static int value = std::max(Words, 2);
+};
+
+// Concurrent open-addressing hash table from State to StateInfo.
+//
+// All records are stored inline in one flat slab. Record is [StateInfo][tag][packed boxes], where tag is
+// (agent << 16 | fingerprint) and packed boxes are only the words needed for level->num_alive cells.
+// Insert claims an empty slot with CAS, lookups don't take any lock, and StateInfo is updated with CAS.
+//
+// In compact mode, packed boxes are replaced by the 64 bit hash of the state, so record doesn't grow with level size.
+// States are then identified by agent and 64 bit fingerprint, and (rare) collisions are silently merged. With verify,
+// full states are also kept on the side, and collisions are counted.
+//
+// Table growth is stop-the-world: grow() waits until no thread is inside the table. Threads announce themselves
+// by incrementing a counter on their own cache line, so there is no shared lock on the common path.
+//
+// save() copies records in chunks, each inside its own reader scope, so other threads keep inserting while it runs.
 template <typename State>
 struct StateMap {
-    constexpr static int SHARDS = 64;
+    StateMap(const Level* level, bool compact = false, bool verify = false)
+            : _compact(compact)
+            , _key_words(compact ? 2 : std::max(1, (level->num_alive + 31) / 32))
+            , _record_words(1 + (sizeof(uint) + _key_words * sizeof(uint) + sizeof(ulong) - 1) / sizeof(ulong))
+            , _verify(verify) {
+        static_assert(sizeof(StateInfo) == sizeof(ulong));
+        allocate(InitialCapacity);
+    }
+
+    // Packed boxes and hash of a state. Can be computed once and reused for several operations.
+    struct Key {
+        small_vector<uint, InlineKeyWords<typename State::Boxes>::value> words;
+        uint tag;
+        ulong hash;
 
-    static int shard(const State& s) { return fmix64(s.boxes.hash() * 7) % SHARDS; }
+        Key(const State& s, int key_words, bool compact) : words(key_words, 0) {
+            hash = s.boxes.hash() ^ fmix64(s.agent);
+            tag = (s.agent << 16) | (hash >> 48) | 2;  // never EmptyTag or BusyTag
+            if (compact) {
+                words[0] = uint(hash);
+                words[1] = uint(hash >> 32);
+            } else {
+                s.boxes.pack(words.data(), key_words);
+            }
+        }
 
-    void print_sizes() {
-        print("states map");
-        for (int i = 0; i < SHARDS; i++) {
-            locks[i].lock();
-            print(" %h", data[i].size());
-            locks[i].unlock();
+        // From tag and words of stored record.
+        Key(const uint* record_tag, int key_words, bool compact) : words(record_tag + 1, record_tag + 1 + key_words) {
+            tag = *record_tag;
+            hash = stored_hash(record_tag, key_words, compact);
         }
-        print("\n");
+    };
+
+    Key key(const State& s) const { return Key(s, _key_words, _compact); }
+
+    // Brings the first probed record into cache ahead of query or add.
+    void prefetch(const Key& key) const {
+        Reader reader(*this);
+        __builtin_prefetch(info(key.hash & (_capacity - 1)));
     }
 
-    void lock(int shard) const {
-        Timestamp lock_ts;
-        locks[shard].lock();
-        overhead += lock_ts.elapsed();
+    // Returns nullopt if state isn't in the map.
+    optional<StateInfo> query(const State& s) const { return query(key(s)); }
+
+    optional<StateInfo> query(const Key& key) const {
+        Reader reader(*this);
+        long i = find(key);
+        if (i == -1) return nullopt;
+        return load(i);
     }
 
-    void lock2(int shard) const {
-        Timestamp lock_ts;
-        locks[shard].lock();
-        overhead2 += lock_ts.elapsed();
+    StateInfo get(const State& s) const {
+        auto si = query(s);
+        if (!si) THROW(runtime_error, "state not found");
+        return *si;
     }
 
-    void unlock(int shard) const { locks[shard].unlock(); }
+    bool contains(const State& s) const { return query(s).has_value(); }
+    bool contains(const Key& key) const { return query(key).has_value(); }
 
-    bool contains(const State& s, int shard) const { return data[shard].find(s) != data[shard].end(); }
+    // Returns false if state was already in the map.
+    bool add(const State& s, const StateInfo& si) { return add(key(s), si); }
+
+    bool add(const Key& key, const StateInfo& si) {
+        while (true) {
+            long capacity;
+            Insert result;
+            bool overloaded = false;
+            {
+                Reader reader(*this);
+                capacity = _capacity;
+                result = insert(key, si);
+                if (result == Inserted && ++reader.slot().size % GrowCheckPeriod == 0) overloaded = size() > capacity * MaxLoad;
+            }
+            if (result == Exists) return false;
+            if (result == Inserted) {
+                if (overloaded) grow(capacity);
+                return true;
+            }
+            grow(capacity);
+        }
+    }
 
-    StateInfo get(const State& s, int shard) const { return data[shard].at(s); }
+    // Atomic min of distance. If si.distance is shorter than existing one, then distance, dir and prev_agent
+    // are replaced (heuristic and closed are kept) and updated info is returned.
+    optional<StateInfo> improve(const State& s, const StateInfo& si) { return improve(key(s), si); }
 
-    const StateInfo* query(const State& s, int shard) const {
-        auto& d = data[shard];
-        auto it = d.find(s);
-        if (it == d.end()) return nullptr;
-        return &it->second;
+    optional<StateInfo> improve(const Key& key, const StateInfo& si) {
+        Reader reader(*this);
+        long i = find(key);
+        if (i == -1) return nullopt;
+        ulong* p = info(i);
+        ulong expected = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        while (true) {
+            StateInfo e = unpack(expected);
+            if (si.distance >= e.distance) return nullopt;
+            e.distance = si.distance;
+            e.dir = si.dir;
+            e.prev_agent = si.prev_agent;
+            if (__atomic_compare_exchange_n(p, &expected, pack(e), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return e;
+        }
     }
 
-    StateInfo* query(const State& s, int shard) {
-        auto& d = data[shard];
-        auto it = d.find(s);
-        if (it == d.end()) return nullptr;
-        return &it->second;
+    // Marks state as closed. Returns info before closing, or nullopt if state is missing or already closed.
+    optional<StateInfo> close(const State& s) {
+        Key key(s, _key_words, _compact);
+        Reader reader(*this);
+        long i = find(key);
+        if (i == -1) return nullopt;
+        ulong* p = info(i);
+        ulong expected = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        while (true) {
+            StateInfo e = unpack(expected);
+            if (e.closed) return nullopt;
+            StateInfo c = e;
+            c.closed = true;
+            if (__atomic_compare_exchange_n(p, &expected, pack(c), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return e;
+        }
     }
 
-    void add(const State& s, const StateInfo& si, int shard) { data[shard].emplace(s, si); }
+    // Clears closed flag. Returns info, or nullopt if state is missing.
+    optional<StateInfo> reopen(const State& s) {
+        Key key(s, _key_words, _compact);
+        Reader reader(*this);
+        long i = find(key);
+        if (i == -1) return nullopt;
+        ulong* p = info(i);
+        ulong expected = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        while (true) {
+            StateInfo e = unpack(expected);
+            e.closed = false;
+            if (__atomic_compare_exchange_n(p, &expected, pack(e), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return e;
+        }
+    }
+
+    // Writes record format, number of records and records. Records inserted while saving may or may not be included.
+    // If table grows between chunks, records have moved, so it starts over from the first chunk.
+    void save(std::ostream& out) const {
+        WritePod<int>(out, _compact);
+        WritePod<int>(out, _key_words);
+        WritePod<int>(out, _record_words);
+        const auto begin = out.tellp();
+        vector<ulong> chunk;
+        while (true) {
+            out.seekp(begin);
+            WritePod<long>(out, 0);
+            long count = 0;
+            long capacity = -1;
+            bool moved = false;
+            for (long first = 0;; first += SaveChunk) {
+                chunk.clear();
+                {
+                    Reader reader(*this);
+                    if (capacity == -1) capacity = _capacity;
+                    if (_capacity != capacity) {
+                        moved = true;
+                        break;
+                    }
+                    if (first >= capacity) break;
+                    for (long i = first; i < std::min(first + SaveChunk, capacity); i++) {
+                        const uint t = __atomic_load_n(tag(i), __ATOMIC_ACQUIRE);
+                        if (t == EmptyTag || t == BusyTag) continue;
+                        const size_t r = chunk.size();
+                        chunk.resize(r + _record_words);
+                        memcpy(chunk.data() + r, info(i), _record_words * sizeof(ulong));
+                        chunk[r] = __atomic_load_n(info(i), __ATOMIC_ACQUIRE);
+                    }
+                }
+                out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size() * sizeof(ulong));
+                count += chunk.size() / _record_words;
+            }
+            if (moved) continue;
+            const auto end = out.tellp();
+            out.seekp(begin);
+            WritePod<long>(out, count);
+            out.seekp(end);
+            return;
+        }
+    }
+
+    // Adds records written by save(). Returns false (and adds nothing) if record format is different.
+    bool load(std::istream& in) {
+        if (ReadPod<int>(in) != _compact || ReadPod<int>(in) != _key_words || ReadPod<int>(in) != _record_words) return false;
+        const long count = ReadPod<long>(in);
+        vector<ulong> chunk;
+        for (long first = 0; first < count; first += SaveChunk) {
+            const long n = std::min(SaveChunk, count - first);
+            chunk.resize(n * _record_words);
+            if (!in.read(reinterpret_cast<char*>(chunk.data()), chunk.size() * sizeof(ulong))) THROW(runtime_error, "truncated checkpoint");
+            for (long r = 0; r < n; r++) {
+                const ulong* record = chunk.data() + r * _record_words;
+                add(Key(reinterpret_cast<const uint*>(record + 1), _key_words, _compact), unpack(record[0]));
+            }
+        }
+        return true;
+    }
+
+    // Only with verify: records full state behind key, and counts it if other state has the same fingerprint.
+    void verify(const State& s, const Key& key) {
+        if (!_verify) return;
+        unique_lock<mutex> lock(_verify_mutex);
+        auto [it, inserted] = _verify_states.emplace(pair{key.tag, key.hash}, s);
+        if (!inserted && !(it->second == s)) _collisions += 1;
+    }
+
+    long collisions() const { return _collisions; }
 
     long size() const {
         long result = 0;
-        for (int i = 0; i < SHARDS; i++) {
-            locks[i].lock();
-            result += data[i].size();
-            locks[i].unlock();
-        }
+        for (const auto& r : _readers) result += r.size;
         return result;
     }
 
+    // Not thread safe.
     void reset() {
-        overhead = 0;
-        overhead2 = 0;
-        for (auto& d : data) d.clear();
+        _grow_ticks = 0;
+        for (auto& r : _readers) r.size = 0;
+        allocate(InitialCapacity);
+        _verify_states.clear();
+        _collisions = 0;
     }
 
     std::string monitor() const {
-        return format("{:.3f} {:.3f}", Timestamp::to_s(overhead), Timestamp::to_s(overhead2));
+        long capacity;
+        {
+            Reader reader(*this);  // _capacity changes while growing
+            capacity = _capacity;
+        }
+        std::string out = format("grow {:.3f}, load {:.2f}, {} bytes/state", Timestamp::to_s(_grow_ticks), double(size()) / capacity, capacity * _record_words * sizeof(ulong) / std::max(1l, size()));
+        if (_verify) out += format(", collisions {}", _collisions.load());
+        return out;
     }
 
 private:
-    mutable array<std::mutex, SHARDS> locks;
-    array<absl::flat_hash_map<State, StateInfo>, SHARDS> data;
-    mutable std::atomic<long> overhead = 0;
-    mutable std::atomic<long> overhead2 = 0;
+    constexpr static long InitialCapacity = 1 << 16;
+    constexpr static double MaxLoad = 0.7;
+    constexpr static long GrowCheckPeriod = 256;
+    constexpr static int Readers = 64;
+    constexpr static long SaveChunk = 1 << 14;  // records
+
+    constexpr static uint EmptyTag = 0;
+    constexpr static uint BusyTag = 1;
+
+    enum Insert { Inserted, Exists, Full };
+
+    struct alignas(64) ReaderSlot {
+        atomic<int> active = 0;
+        atomic<long> size = 0;  // number of inserts by threads using this slot
+    };
+
+    // Scope of a thread inside the table (table can't grow while any thread is inside).
+    struct Reader {
+        Reader(const StateMap& map) : _map(map), _slot(map._readers[index()]) {
+            while (true) {
+                _slot.active += 1;
+                if (!_map._growing) break;
+                _slot.active -= 1;
+                while (_map._growing) std::this_thread::yield();
+            }
+        }
+        ~Reader() { _slot.active -= 1; }
+
+        ReaderSlot& slot() { return _slot; }
+
+       private:
+        static int index() {
+            static atomic<int> next = 0;
+            thread_local int index = next++ % Readers;
+            return index;
+        }
+
+        const StateMap& _map;
+        ReaderSlot& _slot;
+    };
+
+    void allocate(long capacity) {
+        _capacity = capacity;
+        _slab.clear();
+        _slab.resize(capacity * _record_words, 0);
+    }
+
+    ulong* info(long i) const { return const_cast<ulong*>(_slab.data() + i * _record_words); }
+    uint* tag(long i) const { return reinterpret_cast<uint*>(info(i) + 1); }
+    uint* words(long i) const { return tag(i) + 1; }
+
+    static_assert(sizeof(StateInfo) == sizeof(ulong) && std::is_trivially_copyable_v<StateInfo>);
+    static ulong pack(const StateInfo& si) { return std::bit_cast<ulong>(si); }
+    static StateInfo unpack(ulong a) { return std::bit_cast<StateInfo>(a); }
+
+    StateInfo load(long i) const { return unpack(__atomic_load_n(info(i), __ATOMIC_ACQUIRE)); }
+
+    // Waits for BusyTag to be replaced with final tag.
+    static uint load_tag(const uint* p) {
+        uint t = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        while (t == BusyTag) {
+            std::this_thread::yield();
+            t = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        }
+        return t;
+    }
+
+    // Hash of record from its tag (and words), without unpacking the state.
+    static ulong stored_hash(const uint* record_tag, int key_words, bool compact) {
+        const uint* w = record_tag + 1;
+        return compact ? (w[0] | (ulong(w[1]) << 32)) : (zobrist(w, key_words) ^ fmix64(*record_tag >> 16));
+    }
+
+    bool equal_words(long i, const Key& key) const {
+        return memcmp(words(i), key.words.data(), _key_words * sizeof(uint)) == 0;
+    }
+
+    long find(const Key& key) const {
+        const long mask = _capacity - 1;
+        for (long j = 0, i = key.hash & mask; j < _capacity; j++, i = (i + 1) & mask) {
+            uint t = load_tag(tag(i));
+            if (t == EmptyTag) return -1;
+            if (t == key.tag && equal_words(i, key)) return i;
+        }
+        return -1;
+    }
+
+    Insert insert(const Key& key, const StateInfo& si) {
+        const long mask = _capacity - 1;
+        for (long j = 0, i = key.hash & mask; j < _capacity; j++, i = (i + 1) & mask) {
+            uint* p = tag(i);
+            uint t = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+            if (t == EmptyTag) {
+                if (__atomic_compare_exchange_n(p, &t, BusyTag, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                    memcpy(words(i), key.words.data(), _key_words * sizeof(uint));
+                    __atomic_store_n(info(i), pack(si), __ATOMIC_RELAXED);
+                    __atomic_store_n(p, key.tag, __ATOMIC_RELEASE);
+                    return Inserted;
+                }
+                // lost the race for this slot, check who won
+            }
+            if (t == BusyTag) t = load_tag(p);
+            if (t == key.tag && equal_words(i, key)) return Exists;
+        }
+        return Full;
+    }
+
+    // Stop-the-world rehash into 2x larger slab.
+    void grow(long capacity) {
+        bool expected = false;
+        if (!_growing.compare_exchange_strong(expected, true)) {
+            while (_growing) std::this_thread::yield();
+            return;
+        }
+        if (_capacity != capacity) {
+            // other thread already grew it
+            _growing = false;
+            return;
+        }
+        Timestamp grow_ts;
+        for (const auto& r : _readers)
+            while (r.active > 0) std::this_thread::yield();
+
+        vector<ulong> old;
+        std::swap(old, _slab);
+        const long old_capacity = _capacity;
+        allocate(old_capacity * 2);
+
+        const long mask = _capacity - 1;
+        for (long k = 0; k < old_capacity; k++) {
+            const ulong* src = old.data() + k * _record_words;
+            const uint* src_tag = reinterpret_cast<const uint*>(src + 1);
+            if (*src_tag == EmptyTag) continue;
+            long i = stored_hash(src_tag, _key_words, _compact) & mask;
+            while (*tag(i) != EmptyTag) i = (i + 1) & mask;
+            memcpy(info(i), src, _record_words * sizeof(ulong));
+        }
+        _grow_ticks += grow_ts.elapsed();
+        _growing = false;
+    }
+
+    const bool _compact;
+    const int _key_words;  // stored after tag
+    const int _record_words;
+
+    long _capacity;
+    vector<ulong> _slab;
+    atomic<bool> _growing = false;
+    mutable array<ReaderSlot, Readers> _readers;
+    atomic<long> _grow_ticks = 0;
+
+    const bool _verify;
+    mutex _verify_mutex;
+    flat_hash_map<pair<uint, ulong>, State> _verify_states;  // (tag, hash) -> state
+    atomic<long> _collisions = 0;
 };
@@ -0,0 +1,404 @@
+#pragma once
+#include "core/bits_util.h"
+#include "core/timestamp.h"
+#include "core/fmt.h"
+#include "sokoban/common.h"
+
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+template <typename T>
+void ensure_size(vector<T>& vec, size_t s) {
+    if (s > vec.size()) vec.resize(round_up_power2(s));
+}
+
+// Priority queue of states split into one bucket queue per worker thread.
+// Workers push to and pop from their own bucket queue. Worker steals a batch of states from another queue
+// when its own queue is empty, or when other queue has a lower min priority (so global order is only approximate).
+//
+// With memory budget, bucket queues well above min priority are spilled (appended) to one file per bucket when
+// local queue has too many states in memory, and are read back once min priority reaches them. Bucket at min
+// priority is never spilled, so pop and steal only see states in memory. Files are written after releasing local
+// lock, and spill_lock keeps readers of files out until writing is done.
+template <typename State>
+class WorkStealingQueue {
+    constexpr static uint Empty = numeric_limits<uint>::max();
+    constexpr static uint StealBatch = 32;
+    constexpr static uint SpillGap = 4;  // min distance of spilled bucket from min priority
+    constexpr static string_view kSpillPath = "/tmp/sokoban/queue";
+
+    struct alignas(64) Local {
+        mutex lock;
+        vector<array_deque<State>> queue;
+        vector<uint> spilled;  // by priority, states in file (or in to_spill)
+        vector<pair<uint, array_deque<State>>> to_spill;  // buckets taken out by spill(), by priority
+        mutex spill_lock;  // held while writing or reading files, acquired after lock
+        uint min_queue = 0;
+        uint size = 0;  // including spilled
+        uint in_memory = 0;
+        atomic<uint> min_priority = Empty;  // readable without lock (Empty if local queue is empty)
+    };
+
+   public:
+    // memory_budget is max number of states in memory (0 for no limit).
+    WorkStealingQueue(uint concurrency, long memory_budget = 0)
+            : _concurrency(concurrency)
+            , _local_budget(SpillSupported ? memory_budget / concurrency : 0)
+            , _locals(new Local[concurrency]) {
+        reset();
+    }
+
+    ~WorkStealingQueue() { remove_spill_dir(); }
+
+    void push(const State& s, uint priority) {
+        Local& local = _locals[slot()];
+        _size += 1;  // before insert, so that _size never underflows if state is stolen immediately
+
+        Timestamp lock_ts;
+        local.lock.lock();
+        _push_overhead += lock_ts.elapsed();
+        local_push(local, s, priority);
+        unlock(local);
+
+        notify(1);
+    }
+
+    // Pushes all states under one lock acquisition.
+    void push(const vector<pair<State, uint>>& batch) {
+        if (batch.empty()) return;
+        Local& local = _locals[slot()];
+        _size += batch.size();
+
+        Timestamp lock_ts;
+        local.lock.lock();
+        _push_overhead += lock_ts.elapsed();
+        for (const auto& [s, priority] : batch) local_push(local, s, priority);
+        unlock(local);
+
+        notify(batch.size());
+    }
+
+    optional<State> top() const {
+        uint best = Empty;
+        optional<State> result;
+        for (uint i = 0; i < _concurrency; i++) {
+            Local& local = _locals[i];
+            unique_lock lk(local.lock);
+            if (local.size > 0 && local.min_queue < best) {
+                best = local.min_queue;
+                result = local.queue[local.min_queue].front();
+            }
+        }
+        return result;
+    }
+
+    optional<State> pop() {
+        Local& local = _locals[slot()];
+        while (_running) {
+            uint victim = find_victim(local);
+            if (victim != Empty) steal(_locals[victim], local);
+
+            Timestamp lock_ts;
+            local.lock.lock();
+            _pop_overhead += lock_ts.elapsed();
+            if (local.size > 0) {
+                State s = local_pop(local);
+                local.lock.unlock();
+                _size -= 1;
+                return s;
+            }
+            local.lock.unlock();
+
+            if (!wait_for_work()) break;
+        }
+        return nullopt;
+    }
+
+    size_t size() const { return _size; }
+
+    // Number of states in spill files (not in memory).
+    long spilled() const { return _spilled; }
+
+    // Calls fn(state, priority) for all states, including spilled ones. Holds lock of one local queue at a time, and
+    // only while copying one bucket, so workers keep running. States pushed or popped meanwhile may be missed.
+    template <typename Fn>
+    void for_each(const Fn& fn) const {
+        vector<State> bucket;
+        for (uint i = 0; i < _concurrency; i++) {
+            Local& local = _locals[i];
+            for (uint p = 0;; p++) {
+                bucket.clear();
+                {
+                    unique_lock lk(local.lock);
+                    if (p >= local.queue.size()) break;
+                    for (const State& s : local.queue[p]) bucket.push_back(s);
+                    read_spilled(local, p, bucket);
+                }
+                for (const State& s : bucket) fn(s, p);
+            }
+        }
+    }
+
+    void shutdown() {
+        unique_lock<mutex> lk(_wait_lock);
+        _running = false;
+        _push_cv.notify_all();
+        _running_cv.notify_all();
+    }
+
+    template <class Rep, class Period>
+    bool wait_while_running_for(const std::chrono::duration<Rep, Period>& rel_time) const {
+        unique_lock<mutex> lk(_wait_lock);
+        if (_running) _running_cv.wait_for(lk, rel_time);
+        return _running;
+    }
+
+    void reset() {
+        _running = true;
+        _push_overhead = 0;
+        _pop_overhead = 0;
+        _steals = 0;
+        _idle = 0;
+        _size = 0;
+        _next_slot = 0;
+        _spilled = 0;
+        _spill_ticks = 0;
+        remove_spill_dir();
+        _epoch = ++s_epochs;
+        _spill_dir = format("{}/{}_{}", kSpillPath, getpid(), _epoch.load());
+        for (uint i = 0; i < _concurrency; i++) {
+            Local& local = _locals[i];
+            local.queue.clear();
+            local.queue.resize(256);
+            local.spilled.clear();
+            local.spilled.resize(256, 0);
+            local.to_spill.clear();
+            local.min_queue = 0;
+            local.size = 0;
+            local.in_memory = 0;
+            local.min_priority = Empty;
+        }
+    }
+
+    string monitor() const {
+        string out = format("push {:.3f}, pop {:.3f}, steals {}", Timestamp::to_s(_push_overhead), Timestamp::to_s(_pop_overhead), _steals.load());
+        if (_local_budget > 0) out += format(", spilled {}, spill {:.3f}", _spilled.load(), Timestamp::to_s(_spill_ticks));
+        return out;
+    }
+
+   private:
+    // Each thread is assigned its own local queue on the first push or pop (after reset()).
+    uint slot() {
+        thread_local ulong epoch = 0;
+        thread_local uint index = 0;
+        if (epoch != _epoch) {
+            epoch = _epoch;
+            index = _next_slot++ % _concurrency;
+        }
+        return index;
+    }
+
+    void local_push(Local& local, const State& s, uint priority) {
+        ensure_size(local.queue, priority + 1);
+        if (local.spilled.size() < local.queue.size()) local.spilled.resize(local.queue.size(), 0);
+        local.queue[priority].push_back(s);
+        if (local.size == 0 || priority < local.min_queue) local.min_queue = priority;
+        local.size += 1;
+        local.in_memory += 1;
+        if (local.queue[local.min_queue].size() == 0) unspill(local, local.min_queue);
+        if (_local_budget > 0 && local.in_memory > _local_budget) spill(local);
+        publish(local);
+    }
+
+    State local_pop(Local& local) {
+        auto& q = local.queue[local.min_queue];
+        State s = q.front();
+        q.pop_front();
+        local.size -= 1;
+        local.in_memory -= 1;
+        if (local.size > 0) {
+            while (local.queue[local.min_queue].size() == 0 && local.spilled[local.min_queue] == 0) local.min_queue += 1;
+            if (local.queue[local.min_queue].size() == 0) unspill(local, local.min_queue);
+        }
+        publish(local);
+        return s;
+    }
+
+    constexpr static bool SpillSupported = std::is_trivially_copyable_v<State>;
+
+    string spill_file(const Local& local, uint priority) const {
+        return format("{}/{}_{}", _spill_dir, &local - _locals.get(), priority);
+    }
+
+    // Takes highest buckets (at least SpillGap above min priority) out of local, until it is at 3/4 of budget.
+    // They are written to their files by unlock(). Bucket is replaced by a new one, to release its capacity.
+    void spill(Local& local) {
+        if constexpr (SpillSupported) {
+            for (uint p = local.queue.size(); p-- > local.min_queue + SpillGap;) {
+                if (local.in_memory <= _local_budget * 3 / 4) break;
+                auto& q = local.queue[p];
+                if (q.size() == 0) continue;
+                local.spilled[p] += q.size();
+                local.in_memory -= q.size();
+                _spilled += q.size();
+                local.to_spill.emplace_back(p, std::move(q));
+                q = array_deque<State>();
+            }
+        }
+    }
+
+    // Releases local lock, and then appends buckets taken out by spill() to their files.
+    // spill_lock is acquired before releasing local lock, so that no one can read the files before they are complete.
+    void unlock(Local& local) {
+        if (local.to_spill.empty()) {
+            local.lock.unlock();
+            return;
+        }
+        thread_local vector<pair<uint, array_deque<State>>> buckets;
+        buckets.clear();
+        buckets.swap(local.to_spill);
+        unique_lock lk(local.spill_lock);
+        local.lock.unlock();
+
+        Timestamp spill_ts;
+        std::filesystem::create_directories(_spill_dir);
+        for (const auto& [p, q] : buckets) {
+            std::ofstream file(spill_file(local, p), std::ios::binary | std::ios::app);
+            for (const State& s : q) file.write(reinterpret_cast<const char*>(&s), sizeof(State));
+            if (!file) THROW(runtime_error, "failed to write {}", spill_file(local, p));
+        }
+        buckets.clear();
+        _spill_ticks += spill_ts.elapsed();
+    }
+
+    // Appends spilled states of bucket to out (file is kept). Local lock must be held.
+    template <typename Out>
+    void read_spilled(Local& local, uint priority, Out& out) const {
+        if constexpr (SpillSupported) {
+            if (priority >= local.spilled.size() || local.spilled[priority] == 0) return;
+            unique_lock lk(local.spill_lock);
+            const string filename = spill_file(local, priority);
+            std::ifstream file(filename, std::ios::binary);
+            State s;
+            for (uint i = 0; i < local.spilled[priority]; i++) {
+                if (!file.read(reinterpret_cast<char*>(&s), sizeof(State))) THROW(runtime_error, "failed to read {}", filename);
+                out.push_back(s);
+            }
+        }
+    }
+
+    // Reads spilled states of bucket back into memory (and removes the file).
+    void unspill(Local& local, uint priority) {
+        if constexpr (SpillSupported) {
+            if (local.spilled[priority] == 0) return;
+            Timestamp spill_ts;
+            read_spilled(local, priority, local.queue[priority]);
+            std::filesystem::remove(spill_file(local, priority));
+            local.in_memory += local.spilled[priority];
+            _spilled -= local.spilled[priority];
+            local.spilled[priority] = 0;
+            _spill_ticks += spill_ts.elapsed();
+        }
+    }
+
+    void remove_spill_dir() {
+        if (!_spill_dir.empty()) std::filesystem::remove_all(_spill_dir);
+    }
+
+    // Only store on change, to avoid invalidating cache line of other readers.
+    static void publish(Local& local) {
+        uint p = (local.size > 0) ? local.min_queue : Empty;
+        if (local.min_priority.load(std::memory_order_relaxed) != p) local.min_priority.store(p, std::memory_order_relaxed);
+    }
+
+    // Returns local queue with lower min priority than our own (or Empty).
+    uint find_victim(const Local& local) const {
+        uint best = local.min_priority.load(std::memory_order_relaxed);
+        uint victim = Empty;
+        for (uint i = 0; i < _concurrency; i++) {
+            uint p = _locals[i].min_priority.load(std::memory_order_relaxed);
+            if (p < best) {
+                best = p;
+                victim = i;
+            }
+        }
+        return victim;
+    }
+
+    // Moves up to StealBatch states of the lowest priority from victim to local. Never holds both locks.
+    void steal(Local& victim, Local& local) {
+        thread_local vector<State> batch;
+        batch.clear();
+        uint priority = 0;
+
+        Timestamp lock_ts;
+        victim.lock.lock();
+        _pop_overhead += lock_ts.elapsed();
+        if (victim.size > 0) {
+            priority = victim.min_queue;
+            uint count = std::min<uint>(StealBatch, (victim.queue[priority].size() + 1) / 2);
+            while (batch.size() < count) batch.push_back(local_pop(victim));
+        }
+        victim.lock.unlock();
+        if (batch.empty()) return;
+
+        Timestamp lock_ts2;
+        local.lock.lock();
+        _pop_overhead += lock_ts2.elapsed();
+        for (const State& s : batch) local_push(local, s, priority);
+        unlock(local);
+        _steals += 1;
+    }
+
+    void notify(size_t count) {
+        if (_idle == 0) return;
+        // lock is needed to avoid lost wake-up in wait_for_work()
+        _wait_lock.lock();
+        _wait_lock.unlock();
+        if (count == 1)
+            _push_cv.notify_one();
+        else
+            _push_cv.notify_all();
+    }
+
+    // Returns false if search is over (either shutdown or all workers are waiting for work).
+    bool wait_for_work() {
+        unique_lock<mutex> lk(_wait_lock);
+        _idle += 1;
+        while (_size == 0) {
+            if (!_running) break;
+            if (_idle >= _concurrency) {
+                _running = false;
+                _push_cv.notify_all();
+                _running_cv.notify_all();
+                break;
+            }
+            _push_cv.wait(lk);
+        }
+        _idle -= 1;
+        return _running;
+    }
+
+    const uint _concurrency;
+    const long _local_budget;  // 0 if no limit
+    unique_ptr<Local[]> _locals;
+    string _spill_dir;
+
+    atomic<bool> _running = true;
+    atomic<uint> _idle = 0;
+    atomic<long> _size = 0;
+    atomic<uint> _next_slot = 0;
+    atomic<ulong> _epoch = 0;
+    static inline atomic<ulong> s_epochs = 0;
+
+    atomic<long> _push_overhead = 0;
+    atomic<long> _pop_overhead = 0;
+    atomic<long> _steals = 0;
+    atomic<long> _spilled = 0;
+    atomic<long> _spill_ticks = 0;
+
+    mutable mutex _wait_lock;
+    condition_variable _push_cv;
+    mutable condition_variable _running_cv;
+};
@@ -0,0 +1,53 @@
+#include "sokoban/state_queue.h"
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <random>
+
+struct TestState {
+    uint priority;
+    uint index;
+};
+
+// With small memory budget, most states go through spill files, and must come back exactly once in priority order.
+TEST_CASE("WorkStealingQueue spill") {
+    constexpr uint N = 20000, Budget = 200;
+    WorkStealingQueue<TestState> queue(1, Budget);
+    std::mt19937 random(0);
+
+    vector<pair<TestState, uint>> batch;
+    for (uint i = 0; i < N; i++) {
+        const uint priority = random() % 100;
+        if (i % 2)
+            queue.push(TestState{priority, i}, priority);
+        else
+            batch.emplace_back(TestState{priority, i}, priority);
+        if (batch.size() == 50) {
+            queue.push(batch);
+            batch.clear();
+        }
+    }
+    queue.push(batch);
+    REQUIRE(queue.size() == N);
+    REQUIRE(queue.spilled() > N / 2);
+
+    long visited = 0;
+    queue.for_each([&](const TestState& s, uint priority) {
+        REQUIRE(s.priority == priority);
+        visited += 1;
+    });
+    REQUIRE(visited == N);
+
+    vector<bool> popped(N, false);
+    uint last = 0;
+    for (uint i = 0; i < N; i++) {
+        optional<TestState> s = queue.pop();
+        REQUIRE(s.has_value());
+        REQUIRE(s->priority >= last);
+        REQUIRE(!popped[s->index]);
+        popped[s->index] = true;
+        last = s->priority;
+    }
+    REQUIRE(queue.spilled() == 0);
+    REQUIRE(!queue.pop().has_value());
+}
@@ -37,3 +37,42 @@ TEST_CASE("DynamicBoxes", "") {
 TEST_CASE("DenseBoxes<32>", "") {
     Test<DenseBoxes<32>>(4, 8);
 }
+
+template<typename Boxes>
+void TestHash() {
+    Boxes a, b;
+    REQUIRE(a.hash() == 0);
+
+    a.set(3);
+    a.set(40);
+    a.set(3);  // already set
+    a.remove(3);
+    a.add(5);
+    b.set(40);
+    b.set(5);
+    REQUIRE(a == b);
+    REQUIRE(a.hash() == b.hash());
+
+    uint words[2];
+    a.pack(words, 2);
+    REQUIRE(zobrist(words, 2) == a.hash());
+
+    a.reset(5);
+    a.reset(40);
+    a.reset(7);  // not set
+    REQUIRE(a.hash() == 0);
+}
+
+TEST_CASE("DynamicBoxes hash", "") {
+    TestHash<DynamicBoxes>();
+}
+
+// hash computed from words
+TEST_CASE("DenseBoxes<2> hash", "") {
+    TestHash<DenseBoxes<2>>();
+}
+
+// stored hash
+TEST_CASE("DenseBoxes<4> hash", "") {
+    TestHash<DenseBoxes<4>>();
+}
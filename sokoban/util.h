@@ -52,9 +52,11 @@ static bool is_2x3_deadlock(const Cell* pushed_box, const Boxes& boxes) {
     return false;
 }
 
+// Same as is_2x2_deadlock() || is_2x3_deadlock(), but precomputed for all alive cells (see LevelTables).
 template <typename Boxes>
 bool is_simple_deadlock(const Cell* pushed_box, const Boxes& boxes) {
-    return is_2x2_deadlock(pushed_box, boxes) || is_2x3_deadlock(pushed_box, boxes);
+    if (!pushed_box->alive) return is_2x2_deadlock(pushed_box, boxes) || is_2x3_deadlock(pushed_box, boxes);
+    return pushed_box->level->tables.simple_deadlock(pushed_box->id, boxes);
 }
 
 template <typename Boxes>
@@ -135,24 +137,21 @@ Boxes goals_with_frozen_boxes(const Cell* agent, const Boxes& boxes, cspan<Cell*
 // Can agent move to C without pushing any box?
 template <typename Boxes>
 bool is_cell_reachable(const Cell* c, const Cell* agent, const Boxes& boxes) {
-    AgentVisitor visitor(agent);
-    for (const Cell* a : visitor)
-        for (const Cell* b : a->new_moves) {
-            if (c == b) return true;
-            if (!boxes[b->id]) visitor.add(b);
-        }
-    return false;
+    const Bitboard& bitboard = agent->level->bitboard;
+    Bitboard::Bits box_bits, reachable;
+    bitboard.boxes(boxes, box_bits);
+    bitboard.fill(agent->xy, box_bits, reachable);
+    return Bitboard::test(reachable, c->xy);
 }
 
+// Agent is moved to reachable cell with the lowest xy.
 template <typename Boxes>
 const Cell* normalize(const Cell* agent, const Boxes& boxes) {
-    AgentVisitor visitor(agent);
-    for (const Cell* a : visitor) {
-        if (a->id < agent->id) agent = a;
-        for (auto [_, b] : a->moves)
-            if (!boxes[b->id]) visitor.add(b);
-    }
-    return agent;
+    const Bitboard& bitboard = agent->level->bitboard;
+    Bitboard::Bits box_bits, reachable;
+    bitboard.boxes(boxes, box_bits);
+    bitboard.fill(agent->xy, box_bits, reachable);
+    return bitboard.lowest(reachable);
 }
 
 template <typename Boxes>
@@ -160,15 +159,19 @@ void normalize(const Level* level, Agent* agent, const Boxes& boxes) {
     *agent = normalize(level->cells[*agent], boxes)->id;
 }
 
+// Calls push(A, B, d) for every box B which agent can push from A in direction d.
+// Cells reachable by agent are left in reachable (for normalize_push).
 template <typename State, typename PushFn>
-void for_each_push(const Level* level, const State& s, const PushFn& push) {
-    AgentVisitor visitor(level, s.agent);
-    for (const Cell* a : visitor) {
-        for (auto [d, b] : a->actions) {
-            if (!s.boxes[b->id]) {
-                visitor.add(b);
-                continue;
-            }
+void for_each_push(const Level* level, const State& s, Bitboard::Bits& reachable, const PushFn& push) {
+    const Bitboard& bitboard = level->bitboard;
+    Bitboard::Bits box_bits;
+    bitboard.boxes(s.boxes, box_bits);
+    bitboard.fill(level->cells[s.agent]->xy, box_bits, reachable);
+    for (const Cell* b : level->alive()) {
+        if (!s.boxes[b->id]) continue;
+        for (int d = 0; d < 4; d++) {
+            const Cell* a = b->dir(d ^ 2);
+            if (!a || !Bitboard::test(reachable, a->xy)) continue;
             const Cell* c = b->dir(d);
             // TODO remove c->sink
             if (c && (c->alive || c->sink) && !s.boxes[c->id]) push(a, b, d);
@@ -176,6 +179,75 @@ void for_each_push(const Level* level, const State& s, const PushFn& push) {
     }
 }
 
+template <typename State, typename PushFn>
+void for_each_push(const Level* level, const State& s, const PushFn& push) {
+    Bitboard::Bits reachable;
+    for_each_push(level, s, reachable, push);
+}
+
+// Calls pull(A, B, d) for every box B = A->dir(d) which agent can pull from A. After pull, box is on A and agent is
+// on A->dir(d ^ 2). Reverse of push, for backward search.
+template <typename State, typename PullFn>
+void for_each_pull(const Level* level, const State& s, const PullFn& pull) {
+    const Bitboard& bitboard = level->bitboard;
+    Bitboard::Bits box_bits, reachable;
+    bitboard.boxes(s.boxes, box_bits);
+    bitboard.fill(level->cells[s.agent]->xy, box_bits, reachable);
+    for (const Cell* b : level->alive()) {
+        if (!s.boxes[b->id]) continue;
+        for (int d = 0; d < 4; d++) {
+            const Cell* a = b->dir(d ^ 2);
+            if (!a || !a->alive || !Bitboard::test(reachable, a->xy)) continue;
+            const Cell* c = a->dir(d ^ 2);
+            if (c && Bitboard::test(reachable, c->xy)) pull(a, b, d);
+        }
+    }
+}
+
+// Does removing C from the walkable area keep all of its free neighbors connected around it?
+template <typename Boxes>
+bool is_cut_free(const Cell* c, const Boxes& boxes) {
+    // dir8 clockwise from N: N, NE, E, SE, S, SW, W, NW (orthogonal neighbors at even positions).
+    constexpr int Ring[8] = {3, 5, 2, 7, 1, 6, 0, 4};
+    std::array<bool, 8> free;
+    for (int i = 0; i < 8; i++) {
+        const Cell* e = c->dir8[Ring[i]];
+        free[i] = e && !(e->alive && boxes[e->id]);
+    }
+    // Count runs of free ring cells which contain an orthogonal neighbor.
+    int runs = 0;
+    for (int i = 0; i < 8; i++) {
+        if (!free[i] || free[(i + 7) % 8]) continue;
+        for (int j = i; free[j % 8] && j < i + 8; j++)
+            if (j % 2 == 0) {
+                runs += 1;
+                break;
+            }
+    }
+    return runs <= 1;
+}
+
+// Normalizes agent of child state after box was pushed from B to C (with agent on B), using cells reachable in the
+// parent state. Returns false (and does full fill instead) if push can change connectivity other than freeing B and
+// blocking C.
+template <typename Boxes>
+bool normalize_push(const Level* level, const Bitboard::Bits& parent_reachable, const Cell* b, const Cell* c, const Boxes& boxes, Agent* agent) {
+    const Bitboard& bitboard = level->bitboard;
+    const Cell* lowest = bitboard.lowest(parent_reachable);
+    bool incremental = true;
+    if (Bitboard::test(parent_reachable, c->xy) && (c == lowest || !is_cut_free(c, boxes))) incremental = false;
+    // B must not open up any new area.
+    for (auto [_, e] : b->moves)
+        if (e != c && !Bitboard::test(parent_reachable, e->xy) && !(e->alive && boxes[e->id])) incremental = false;
+
+    if (!incremental) {
+        normalize(level, agent, boxes);
+        return false;
+    }
+    *agent = (b->xy < lowest->xy) ? b->id : lowest->id;
+    return true;
+}
+
 using Continue = Symbol<symbol_hash("continue")>;
 using Break = Symbol<symbol_hash("break")>;
 using Deadlock = Symbol<symbol_hash("deadlock")>;
@@ -183,12 +255,9 @@ using Deadlock = Symbol<symbol_hash("deadlock")>;
 // Can push the same box multiple times!
 template <typename Boxes, typename Out>
 variant<Continue, Break> for_each_multi_push(const Level* level, const Cell* agent, Boxes boxes, const Cell* dont_select_box, const Out& out) {
-    AgentVisitor reachable(agent);
-    for (const Cell* a : reachable) {
-        for (auto [_, b] : a->moves) {
-            if (!boxes[b->id]) reachable.add(b);
-        }
-    }
+    Bitboard::Bits box_bits, reachable;
+    level->bitboard.boxes(boxes, box_bits);
+    level->bitboard.fill(agent->xy, box_bits, reachable);
 
     AgentBoxVisitor visitor(level);
     for (const Cell* sb : level->alive()) {
@@ -197,7 +266,7 @@ variant<Continue, Break> for_each_multi_push(const Level* level, const Cell* age
         boxes.remove(sb);
         visitor.clear();
         for (auto [d, a] : sb->moves) {
-            if (reachable.visited(a)) {
+            if (Bitboard::test(reachable, a->xy)) {
                 const Cell* c = sb->dir(d ^ 2);
                 if (c && c->alive) {
                     boxes.add(c);